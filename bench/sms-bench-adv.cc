@@ -0,0 +1,79 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Heap allocations and time per advertisement: the old Send() path, which
+ * encoded the file list and rebuilt the packet on every call, against the
+ * cached packet of SmsEchoClient::GetAdvertisement().
+ *
+ * Needs ns-3, build with ../build-bench.sh.
+ */
+#include "../sms-echo-client.h"
+#include "ns3/packet.h"
+#include "sms-bench.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ns3;
+
+// The old Send(): EncodeFilesForAdv mallocs the list, Send mallocs the
+// packet (sized by the number of known files), SetFill copies it into
+// m_data and Create<Packet> copies it again.
+static uint8_t* m_data = 0;
+static uint32_t m_dataSize = 0;
+
+static Ptr<Packet> legacy_advertisement(std::vector<FileSMS> &files) {
+  uint8_t adv[] = {0};
+  uint8_t num_files[] = {(uint8_t) files.size()};
+  uint16_t* encoded_files = (uint16_t*) malloc(files.size()*2*sizeof(uint16_t));
+  for (uint32_t i = 0; i < files.size(); i++) {
+    encoded_files[i*2] = (uint16_t) files[i].getFileId();
+    encoded_files[i*2+1] = (uint16_t) files[i].getFileSize();
+  }
+  size_t full_length_of_packet = sizeof(adv)*2+sizeof(uint16_t)*files.size()*2;
+  uint8_t* full_packet = (uint8_t*) malloc(full_length_of_packet);
+  memcpy(full_packet, adv, sizeof(adv));
+  memcpy(full_packet+sizeof(adv), num_files, sizeof(num_files));
+  memcpy(full_packet+sizeof(adv)+sizeof(num_files), encoded_files, sizeof(uint16_t)*files.size()*2);
+  free(encoded_files);
+  if (full_length_of_packet != m_dataSize) {
+    delete [] m_data;
+    m_data = new uint8_t [full_length_of_packet];
+    m_dataSize = full_length_of_packet;
+  }
+  memcpy(m_data, full_packet, full_length_of_packet);
+  free(full_packet);
+  return Create<Packet> (m_data, m_dataSize);
+}
+
+int main() {
+  const uint32_t num_of_files[] = {1, 10, 100, 250};
+  const uint32_t iterations = 100000;
+  printf("%6s %14s %14s %12s %12s\n", "files", "legacy allocs", "cached allocs", "legacy ns", "cached ns");
+  for (size_t n = 0; n < sizeof(num_of_files)/sizeof(num_of_files[0]); n++) {
+    std::vector<FileSMS> files;
+    for (uint32_t i = 0; i < num_of_files[n]; i++) {
+      files.push_back(FileSMS(i, 1000));
+    }
+    Ptr<SmsEchoClient> app = CreateObject<SmsEchoClient> ();
+    app->SetFiles(files);
+
+    uint64_t allocs = g_allocs;
+    double start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+      Ptr<Packet> p = legacy_advertisement(files);
+    }
+    double legacy_ns = (now_ns() - start) / iterations;
+    double legacy_allocs = (g_allocs - allocs) / (double) iterations;
+
+    allocs = g_allocs;
+    start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+      Ptr<Packet> p = app->GetAdvertisement()->Copy();
+    }
+    double cached_ns = (now_ns() - start) / iterations;
+    double cached_allocs = (g_allocs - allocs) / (double) iterations;
+
+    printf("%6u %14.2f %14.2f %12.1f %12.1f\n", num_of_files[n], legacy_allocs, cached_allocs, legacy_ns, cached_ns);
+  }
+  delete [] m_data;
+  return 0;
+}
@@ -0,0 +1,133 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Compares the word-packed ChunkBitmap against the std::vector<bool> code
+ * FileSMSChunks used before: construction, first missing chunk search and
+ * counting missing chunks in a range.
+ *
+ * Build with ../build-bench.sh, run without arguments.
+ */
+#include "../sms-chunk-bitmap.h"
+#include <cstdio>
+#include <time.h>
+#include <vector>
+
+static volatile uint64_t sink;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+// The old FileSMSChunks constructor loop
+static std::vector<bool> legacy_build(uint32_t num_of_chunks, bool value) {
+  std::vector<bool> chunks;
+  for (size_t i = 0; i < num_of_chunks; i++) {
+    if (value)
+      chunks.push_back(true);
+    else
+      chunks.push_back(false);
+  }
+  return chunks;
+}
+
+// The old FileSMSChunks::get_first_missing_chunk
+static uint32_t legacy_first_missing(const std::vector<bool> &chunks) {
+  uint32_t first_missing_chunk = 0;
+  for (;first_missing_chunk < chunks.size(); first_missing_chunk++) {
+    if (!chunks[first_missing_chunk]) {
+      break;
+    }
+  }
+  return first_missing_chunk;
+}
+
+static uint32_t legacy_count_missing(const std::vector<bool> &chunks, uint32_t begin, uint32_t end) {
+  uint32_t missing = 0;
+  for (uint32_t i = begin; i < end; i++) {
+    if (!chunks[i])
+      missing++;
+  }
+  return missing;
+}
+
+static uint32_t iterations_for(uint32_t num_of_chunks) {
+  uint32_t iterations = 20000000 / (num_of_chunks + 1);
+  return iterations < 10 ? 10 : iterations;
+}
+
+static void report(const char* op, uint32_t num_of_chunks, double legacy_ns, double bitmap_ns) {
+  printf("%-14s %9u %14.1f %14.1f %9.1fx\n", op, num_of_chunks, legacy_ns, bitmap_ns, legacy_ns/bitmap_ns);
+}
+
+static void bench_build(uint32_t num_of_chunks) {
+  uint32_t iterations = iterations_for(num_of_chunks);
+  double start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    std::vector<bool> chunks = legacy_build(num_of_chunks, i & 1);
+    sink += chunks.size();
+  }
+  double legacy_ns = (now_ns() - start) / iterations;
+  start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    ChunkBitmap chunks(num_of_chunks, i & 1);
+    sink += chunks.size();
+  }
+  double bitmap_ns = (now_ns() - start) / iterations;
+  report("build", num_of_chunks, legacy_ns, bitmap_ns);
+}
+
+// Every chunk is present except 'missing', the usual state of a file that
+// is nearly done.
+static void bench_first_missing(uint32_t num_of_chunks, uint32_t missing) {
+  std::vector<bool> legacy = legacy_build(num_of_chunks, true);
+  ChunkBitmap bitmap(num_of_chunks, true);
+  legacy[missing] = false;
+  bitmap.reset(missing);
+  uint32_t iterations = iterations_for(num_of_chunks);
+  double start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sink += legacy_first_missing(legacy);
+  }
+  double legacy_ns = (now_ns() - start) / iterations;
+  start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sink += bitmap.find_first_zero();
+  }
+  double bitmap_ns = (now_ns() - start) / iterations;
+  report(missing == num_of_chunks/2 ? "first_mid" : "first_last", num_of_chunks, legacy_ns, bitmap_ns);
+}
+
+static void bench_count_missing(uint32_t num_of_chunks) {
+  std::vector<bool> legacy = legacy_build(num_of_chunks, false);
+  ChunkBitmap bitmap(num_of_chunks, false);
+  for (uint32_t i = 0; i < num_of_chunks; i += 3) {
+    legacy[i] = true;
+    bitmap.set(i);
+  }
+  uint32_t iterations = iterations_for(num_of_chunks);
+  double start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sink += legacy_count_missing(legacy, 1, num_of_chunks - 1);
+  }
+  double legacy_ns = (now_ns() - start) / iterations;
+  start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sink += bitmap.count_zeros(1, num_of_chunks - 1);
+  }
+  double bitmap_ns = (now_ns() - start) / iterations;
+  report("count_missing", num_of_chunks, legacy_ns, bitmap_ns);
+}
+
+int main() {
+  // 690 chunks is one 1000 KB file with 1450 byte chunks
+  const uint32_t sizes[] = {690, 6897, 68966, 689656};
+  printf("%-14s %9s %14s %14s %10s\n", "op", "chunks", "vector<bool> ns", "bitmap ns", "speedup");
+  for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    bench_build(sizes[i]);
+    bench_first_missing(sizes[i], sizes[i]/2);
+    bench_first_missing(sizes[i], sizes[i] - 1);
+    bench_count_missing(sizes[i]);
+  }
+  return 0;
+}
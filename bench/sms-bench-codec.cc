@@ -0,0 +1,94 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Bytes on air and encode/decode cost per advertised file for the old raw
+ * (uint16_t id, uint16_t size) advertisement and the list and Bloom modes
+ * of sms-adv-codec.h. Holdings are drawn from a Zipf(1.1) catalog the way
+ * getInitialFileList does it.
+ *
+ * Build with ../build-bench.sh, run without arguments.
+ */
+#include "../sms-adv-codec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <time.h>
+
+static volatile uint64_t sink;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static std::vector<AdvEntry> zipf_holdings(uint32_t catalog_size, uint32_t num_of_files) {
+  std::vector<double> cdf(catalog_size);
+  double sum = 0;
+  for (uint32_t i = 0; i < catalog_size; i++) {
+    sum += 1.0 / std::pow(i + 1.0, 1.1);
+    cdf[i] = sum;
+  }
+  std::set<uint32_t> ids;
+  while (ids.size() < num_of_files) {
+    double u = (rand() / (RAND_MAX + 1.0)) * sum;
+    ids.insert(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin() + 1);
+  }
+  std::vector<AdvEntry> files;
+  for (std::set<uint32_t>::iterator it = ids.begin(); it != ids.end(); ++it) {
+    // One file in twenty doesn't have the usual size
+    AdvEntry entry = {*it, rand() % 20 ? 1000u : 500 + rand() % 1000u};
+    files.push_back(entry);
+  }
+  std::random_shuffle(files.begin(), files.end());
+  return files;
+}
+
+static void bench(const char* mode, std::vector<AdvEntry> files, uint32_t bloom_threshold) {
+  uint32_t n = files.size();
+  uint32_t iterations = 2000000 / n + 1;
+  std::vector<AdvEntry> scratch;
+  std::vector<uint8_t> out;
+
+  double start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    scratch = files;
+    adv_encode(scratch, bloom_threshold, 1450, out);
+  }
+  double encode_ns = (now_ns() - start) / iterations / n;
+
+  start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    AdvDecoder decoder(&out[0], out.size());
+    if (decoder.get_mode() == ADV_MODE_BLOOM) {
+      for (uint32_t j = 0; j < n; j++) {
+        sink += decoder.may_contain(files[j].file_id);
+      }
+    } else {
+      AdvEntry entry;
+      while (decoder.next(entry)) {
+        sink += entry.file_id;
+      }
+    }
+  }
+  double decode_ns = (now_ns() - start) / iterations / n;
+
+  printf("%-6s %7u %10u %10.2f %10.1f %10.1f\n", mode, n, (uint32_t) out.size(), out.size() / (double) n, encode_ns, decode_ns);
+}
+
+int main() {
+  const uint32_t catalog_sizes[] = {100, 1000, 100000, 1000000};
+  const uint32_t num_of_files[] = {10, 100, 1000, 10000};
+  printf("%-6s %7s %10s %10s %10s %10s\n", "mode", "files", "bytes", "bytes/file", "enc ns/f", "dec ns/f");
+  for (size_t i = 0; i < sizeof(num_of_files)/sizeof(num_of_files[0]); i++) {
+    std::vector<AdvEntry> files = zipf_holdings(catalog_sizes[i], num_of_files[i]);
+    // The old format: packet type, uint8_t count, raw uint16_t pairs. It
+    // can't describe more than 255 files or ids above 65535 at all.
+    uint32_t n = files.size();
+    printf("%-6s %7u %10u %10.2f %10s %10s\n", "raw", n, 2 + 4*n, (2 + 4*n) / (double) n, "-", "-");
+    bench("list", files, 0);
+    bench("bloom", files, 1);
+  }
+  return 0;
+}
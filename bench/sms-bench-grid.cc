@@ -0,0 +1,112 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Cost per frame of finding the receivers of a broadcast, checking every
+ * node against looking them up in the SpatialGrid of sms-spatial-grid.h,
+ * for 100 to 30000 nodes at the density of sms-main (25 nodes on 100 by
+ * 100 m) with a range of 25 m.
+ *
+ * Like in tools/sms-contact-sim the grid holds a snapshot of the positions,
+ * the nodes then move up to half the range and every node sends one frame
+ * before the grid is built again; the grid's column includes building it.
+ * Checks that both find the same receivers; exits with 1 if they don't.
+ *
+ * Doesn't need ns-3, build with ../build-bench.sh.
+ */
+#include "../sms-spatial-grid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#include <vector>
+
+#define RANGE 25.0
+#define MARGIN (RANGE / 2)
+// m^2 per node
+#define AREA_PER_NODE 400.0
+
+static volatile uint64_t sink;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static double uniform(double min, double max) {
+  return min + (max - min) * (rand() / (RAND_MAX + 1.0));
+}
+
+static bool bench_nodes(uint32_t num_of_nodes) {
+  double side = std::sqrt(num_of_nodes * AREA_PER_NODE);
+  std::vector<double> grid_x(num_of_nodes), grid_y(num_of_nodes), x(num_of_nodes), y(num_of_nodes);
+  for (uint32_t i = 0; i < num_of_nodes; i++) {
+    x[i] = uniform(0, side);
+    y[i] = uniform(0, side);
+  }
+  SpatialGrid grid;
+  grid.set_area(0, side, 0, side, RANGE + MARGIN);
+
+  // About 2 s per node count
+  uint32_t rounds = 200000000 / ((uint64_t) num_of_nodes * num_of_nodes) + 2;
+  std::vector<uint32_t> exhaustive, indexed;
+  double exhaustive_ns = 0, grid_ns = 0;
+  uint64_t frames = 0, receivers = 0;
+  bool ok = true;
+  for (uint32_t round = 0; round < rounds; round++) {
+    double start = now_ns();
+    grid_x = x;
+    grid_y = y;
+    grid.build(grid_x, grid_y);
+    grid_ns += now_ns() - start;
+    // Up to MARGIN in any direction, staying in the area
+    for (uint32_t i = 0; i < num_of_nodes; i++) {
+      double angle = uniform(0, 2*M_PI), distance = uniform(0, MARGIN);
+      x[i] = std::min(side, std::max(0.0, x[i] + distance * std::cos(angle)));
+      y[i] = std::min(side, std::max(0.0, y[i] + distance * std::sin(angle)));
+    }
+
+    for (uint32_t sender = 0; sender < num_of_nodes; sender++) {
+      start = now_ns();
+      exhaustive.clear();
+      for (uint32_t i = 0; i < num_of_nodes; i++) {
+        double dx = x[i] - x[sender], dy = y[i] - y[sender];
+        if (i != sender && dx*dx + dy*dy <= RANGE*RANGE)
+          exhaustive.push_back(i);
+      }
+      exhaustive_ns += now_ns() - start;
+
+      start = now_ns();
+      indexed.clear();
+      grid.find(x[sender], y[sender], RANGE + MARGIN, indexed);
+      std::sort(indexed.begin(), indexed.end());
+      size_t kept = 0;
+      for (size_t j = 0; j < indexed.size(); j++) {
+        uint32_t i = indexed[j];
+        double dx = x[i] - x[sender], dy = y[i] - y[sender];
+        if (i != sender && dx*dx + dy*dy <= RANGE*RANGE)
+          indexed[kept++] = i;
+      }
+      indexed.resize(kept);
+      grid_ns += now_ns() - start;
+
+      ok = ok && indexed == exhaustive;
+      receivers += exhaustive.size();
+      frames++;
+    }
+  }
+  sink += receivers;
+  printf("%8u %8.0f %16.1f %12.1f %8.1fx %16.1f %6s\n", num_of_nodes, side, exhaustive_ns / frames,
+         grid_ns / frames, exhaustive_ns / grid_ns, (double) receivers / frames, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  printf("%8s %8s %16s %12s %9s %16s %6s\n", "nodes", "side m", "exhaustive ns", "grid ns", "speedup",
+         "receivers/frame", "check");
+  bool ok = true;
+  uint32_t sizes[] = {100, 300, 1000, 3000, 10000, 30000};
+  for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    ok = bench_nodes(sizes[i]) && ok;
+  return ok ? 0 : 1;
+}
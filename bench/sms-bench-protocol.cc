@@ -0,0 +1,198 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Cost of the protocol bookkeeping of one node, without simulating the
+ * radio: building files, encoding our advertisement, decoding the
+ * advertisements of first-time and known neighbours, picking the file to
+ * request and storing new chunks.
+ *
+ * The node and every neighbour hold between 1 and min(100, max(10,
+ * catalog/100)) files drawn with the Zipf(1.1) popularity getInitialFileList
+ * uses. Results go to stdout as CSV, one line per operation and scenario:
+ *
+ *   op,catalog,neighbours,ops,ns_per_op,allocs_per_op,bytes_per_op
+ *
+ * Usage: sms-bench-protocol [--catalogs=100,10000,100000]
+ *                           [--neighbours=10,100,1000,10000] [--seed=1]
+ *
+ * Runs SmsProtocol directly, without ns-3. Build with ../build-bench.sh.
+ */
+#include "../sms-protocol.h"
+#include "sms-bench.h"
+#include <cstdio>
+#include <set>
+#include <sstream>
+#include <string>
+
+static volatile uint64_t sink;
+
+struct NewChunk {
+  uint32_t file_id;
+  uint32_t file_size;
+  uint32_t chunk_id;
+  uint32_t sender;
+};
+
+// The operations measured here neither send nor schedule anything, time
+// stands still so no neighbour expires
+class BenchHost : public SmsProtocolHost {
+public:
+  virtual double now() const { return 0; }
+  virtual double random() { return 0.5; }
+  virtual void schedule(SmsTimer, double) {}
+  virtual void cancel(SmsTimer) {}
+  virtual bool is_pending(SmsTimer) const { return false; }
+  virtual void send(const uint8_t*, size_t, uint32_t) {}
+  virtual void send_advertisement(const std::vector<uint8_t> &, uint32_t) {}
+};
+
+static void report(const char* op, uint32_t catalog, uint32_t neighbours, uint64_t ops, const BenchTimer &timer) {
+  double ns = timer.ns_per_op(ops);
+  double allocs = timer.allocs_per_op(ops);
+  double bytes = timer.bytes_per_op(ops);
+  printf("%s,%u,%u,%llu,%.1f,%.3f,%.1f\n", op, catalog, neighbours, (unsigned long long) ops, ns, allocs, bytes);
+  fflush(stdout);
+}
+
+static std::vector<uint32_t> parse_list(const std::string &list) {
+  std::vector<uint32_t> values;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    values.push_back(atoi(item.c_str()));
+  return values;
+}
+
+static std::vector<FileSMS> holdings(const ZipfSampler &zipf, uint32_t catalog) {
+  uint32_t max_files = std::min(100u, std::max(10u, catalog / 100));
+  uint32_t num_of_files = 1 + rand() % std::min(max_files, catalog);
+  std::set<uint32_t> ids;
+  while (ids.size() < num_of_files)
+    ids.insert(zipf.next());
+  std::vector<FileSMS> files;
+  for (std::set<uint32_t>::iterator it = ids.begin(); it != ids.end(); ++it)
+    files.push_back(FileSMS(*it, 1000));
+  return files;
+}
+
+static std::vector<uint8_t> advertisement(const std::vector<FileSMS> &files) {
+  std::vector<AdvEntry> entries(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    entries[i].file_id = files[i].getFileId();
+    entries[i].file_size = files[i].getFileSize();
+  }
+  std::vector<uint8_t> out;
+  adv_encode(entries, 0, DEFAULT_CHUNK_SIZE, out);
+  return out;
+}
+
+static void bench_file_construct() {
+  const uint64_t ops = 100000;
+  BenchTimer timer;
+  for (uint64_t i = 0; i < ops; i++) {
+    FileSMSChunks file(i, 1000, i & 1, DEFAULT_CHUNK_SIZE);
+    sink += file.file_size_in_chunks;
+  }
+  report("file_construct", 0, 0, ops, timer);
+}
+
+static void bench_node(uint32_t catalog, uint32_t num_of_neighbours) {
+  ZipfSampler zipf(catalog);
+  BenchHost host;
+  SmsProtocol node_protocol;
+  SmsProtocol* node = &node_protocol;
+  node->SetHost(&host);
+  node->SetFiles(holdings(zipf, catalog));
+
+  std::vector<uint32_t> addresses;
+  std::vector<std::vector<uint8_t> > advs;
+  for (uint32_t i = 0; i < num_of_neighbours; i++) {
+    // 10.1.0.0/16 like sms-main
+    addresses.push_back(0x0A010101 + i);
+    advs.push_back(advertisement(holdings(zipf, catalog)));
+  }
+  std::vector<uint32_t> order(1000000);
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = rand() % num_of_neighbours;
+
+  std::vector<uint8_t> buffer;
+  uint64_t ops = 100000;
+  BenchTimer encode_timer;
+  for (uint64_t i = 0; i < ops; i++) {
+    node->EncodeFilesForAdv(buffer);
+    sink += buffer.size();
+  }
+  report("encode_adv", catalog, num_of_neighbours, ops, encode_timer);
+
+  // Meeting every neighbour for the first time builds up the state the
+  // other operations run against
+  BenchTimer first_timer;
+  for (uint32_t i = 0; i < num_of_neighbours; i++)
+    sink += node->DecodeFilesForAdv(&advs[i][0], advs[i].size(), addresses[i]);
+  report("decode_adv_first", catalog, num_of_neighbours, num_of_neighbours, first_timer);
+
+  ops = 100000;
+  BenchTimer repeat_timer;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint32_t n = order[i % order.size()];
+    sink += node->DecodeFilesForAdv(&advs[n][0], advs[n].size(), addresses[n]);
+  }
+  report("decode_adv_repeat", catalog, num_of_neighbours, ops, repeat_timer);
+
+  ops = order.size();
+  BenchTimer request_timer;
+  for (uint64_t i = 0; i < ops; i++)
+    sink += node->getFileToRequest(addresses[order[i]]);
+  report("get_file_to_request", catalog, num_of_neighbours, ops, request_timer);
+
+  // Round robin over the partial files, chunk by chunk, each from a holder
+  const FileTable &files = node->files;
+  const std::vector<uint32_t> partial = files.partial_files();
+  std::vector<NewChunk> chunks;
+  for (uint32_t chunk = 0; chunks.size() < 200000 && !partial.empty(); chunk++) {
+    bool any = false;
+    for (size_t i = 0; i < partial.size() && chunks.size() < 200000; i++) {
+      const FileSMSChunks &file = files[partial[i]];
+      if (chunk >= file.file_size_in_chunks)
+        continue;
+      NewChunk c = {file.getFileId(), (uint32_t) file.getFileSize(), chunk,
+        files.neighbours().get_address(file.holders.find_next(0))};
+      chunks.push_back(c);
+      any = true;
+    }
+    if (!any)
+      break;
+  }
+  if (chunks.empty())
+    return;
+  BenchTimer chunk_timer;
+  for (size_t i = 0; i < chunks.size(); i++)
+    sink += node->add_new_chunk(chunks[i].file_id, chunks[i].file_size, chunks[i].chunk_id, chunks[i].sender);
+  report("add_new_chunk", catalog, num_of_neighbours, chunks.size(), chunk_timer);
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<uint32_t> catalogs = parse_list("100,10000,100000");
+  std::vector<uint32_t> neighbours = parse_list("10,100,1000,10000");
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 11, "--catalogs=") == 0)
+      catalogs = parse_list(arg.substr(11));
+    else if (arg.compare(0, 13, "--neighbours=") == 0)
+      neighbours = parse_list(arg.substr(13));
+    else if (arg.compare(0, 7, "--seed=") == 0)
+      seed = atoi(arg.c_str() + 7);
+    else {
+      fprintf(stderr, "Unknown option %s, see the comment at the top of bench/sms-bench-protocol.cc\n", argv[i]);
+      return 1;
+    }
+  }
+  srand(seed);
+
+  printf("op,catalog,neighbours,ops,ns_per_op,allocs_per_op,bytes_per_op\n");
+  bench_file_construct();
+  for (size_t c = 0; c < catalogs.size(); c++)
+    for (size_t n = 0; n < neighbours.size(); n++)
+      bench_node(catalogs[c], neighbours[n]);
+  return 0;
+}
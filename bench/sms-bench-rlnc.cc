@@ -0,0 +1,123 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Throughput of the GF(2^8) kernels of sms-gf256.h, table lookups against
+ * the vector kernels the compiler targets, and of encoding and decoding a
+ * generation of 1450 byte chunks with sms-rlnc.h: MB/s of coded packets
+ * produced and of chunks recovered.
+ * Checks that every decoded generation matches what was encoded; exits
+ * with 1 if one doesn't.
+ *
+ * Doesn't need ns-3, build with ../build-bench.sh (-march=native picks the
+ * SSSE3 or AVX2 kernels).
+ */
+#include "../sms-gf256.h"
+#include "../sms-rlnc.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <vector>
+
+#define CHUNK_BYTES 1450
+
+static volatile uint64_t sink;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static double mb_per_s(double bytes, double ns) {
+  return bytes / ns * 1e3;
+}
+
+static void bench_kernels() {
+  const uint32_t iterations = 200000;
+  std::vector<uint8_t> src(CHUNK_BYTES), dst(CHUNK_BYTES);
+  for (size_t i = 0; i < src.size(); i++)
+    src[i] = rand();
+
+  double start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++)
+    gf256_mul_add_scalar(&dst[0], &src[0], (uint8_t) (i | 2), CHUNK_BYTES);
+  double scalar_ns = now_ns() - start;
+  sink += dst[0];
+
+  start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++)
+    gf256_mul_add(&dst[0], &src[0], (uint8_t) (i | 2), CHUNK_BYTES);
+  double vector_ns = now_ns() - start;
+  sink += dst[0];
+
+  // Both have to compute the same thing
+  std::vector<uint8_t> a(CHUNK_BYTES, 0x5A), b(CHUNK_BYTES, 0x5A);
+  bool ok = true;
+  for (uint32_t c = 0; c < 256; c++) {
+    gf256_mul_add_scalar(&a[0], &src[0], c, CHUNK_BYTES);
+    gf256_mul_add(&b[0], &src[0], c, CHUNK_BYTES);
+    gf256_scale_scalar(&a[0], c | 1, CHUNK_BYTES);
+    gf256_scale(&b[0], c | 1, CHUNK_BYTES);
+    ok = ok && a == b;
+  }
+
+  double bytes = (double) iterations * CHUNK_BYTES;
+  printf("%-8s %12s %12s %8s %6s\n", "kernel", "table MB/s", "vector MB/s", "speedup", "check");
+  printf("%-8s %12.0f %12.0f %7.1fx %6s\n\n", gf256_kernel_name(), mb_per_s(bytes, scalar_ns),
+         mb_per_s(bytes, vector_ns), scalar_ns / vector_ns, ok ? "ok" : "FAILED");
+  if (!ok)
+    exit(1);
+}
+
+// Encodes and decodes generations of num_of_chunks chunks
+static bool bench_generation(uint32_t num_of_chunks) {
+  uint32_t generations = 20000 / (num_of_chunks * num_of_chunks / 8 + 1) + 10;
+  std::vector<uint8_t> data(num_of_chunks * CHUNK_BYTES);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = rand();
+  std::vector<const uint8_t*> chunks(num_of_chunks);
+  for (uint32_t i = 0; i < num_of_chunks; i++)
+    chunks[i] = &data[i * CHUNK_BYTES];
+  std::vector<uint8_t> coefficients(num_of_chunks);
+  // A few more packets than chunks, some of them may be dependent
+  uint32_t num_of_packets = num_of_chunks + 4;
+  std::vector<uint8_t> packets(num_of_packets * CHUNK_BYTES);
+
+  double encode_ns = 0, decode_ns = 0;
+  uint32_t packets_used = 0;
+  bool ok = true;
+  for (uint32_t g = 0; g < generations; g++) {
+    double start = now_ns();
+    for (uint32_t p = 0; p < num_of_packets; p++)
+      rlnc_encode(&chunks[0], num_of_chunks, CHUNK_BYTES, g * num_of_packets + p + 1, &packets[p * CHUNK_BYTES]);
+    encode_ns += now_ns() - start;
+
+    start = now_ns();
+    RlncDecoder decoder(num_of_chunks, CHUNK_BYTES);
+    for (uint32_t p = 0; p < num_of_packets && !decoder.is_complete(); p++) {
+      rlnc_coefficients(g * num_of_packets + p + 1, &coefficients[0], num_of_chunks);
+      decoder.add_coded(&coefficients[0], &packets[p * CHUNK_BYTES]);
+      packets_used++;
+    }
+    decode_ns += now_ns() - start;
+
+    ok = ok && decoder.is_complete();
+    for (uint32_t i = 0; ok && i < num_of_chunks; i++)
+      ok = memcmp(decoder.get_chunk(i), chunks[i], CHUNK_BYTES) == 0;
+  }
+  double bytes = (double) generations * num_of_chunks * CHUNK_BYTES;
+  printf("%10u %12.0f %12.0f %14.3f %6s\n", num_of_chunks,
+         mb_per_s((double) generations * num_of_packets * CHUNK_BYTES, encode_ns), mb_per_s(bytes, decode_ns),
+         packets_used / (double) (generations * num_of_chunks), ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  bench_kernels();
+  printf("%10s %12s %12s %14s %6s\n", "generation", "encode MB/s", "decode MB/s", "packets/chunk", "check");
+  bool ok = true;
+  uint32_t sizes[] = {4, 8, 16, 32, 64, 128};
+  for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    ok = bench_generation(sizes[i]) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * How the wall time of a whole simulation grows with the number of nodes.
+ * Runs sms-main (or tools/sms-contact-sim with --bin) once per node count
+ * of --nodes, one after the other so that they don't compete for the CPU,
+ * and writes CSV with one row per run to stdout: simulated seconds, wall
+ * time per simulated second, peak RSS and events executed, normalised per
+ * node and event.
+ *
+ * 'exponent' is log(wall per simulated second ratio) / log(node ratio)
+ * against the previous row: about 1 while the cost per node stays the
+ * same, more where something grows superlinearly.
+ *
+ * By default the area grows with the node count so that the density of
+ * the first scenario stays the same, --scaleArea=0 keeps it. Runs go on
+ * until --duration, convergence doesn't stop them.
+ *
+ * Needs ns-3 for its command line, build with ../build-bench.sh and run
+ * from the bench directory:
+ *
+ *     ./sms-bench-scaling --nodes=25,100,500,2000 --duration=30 > scaling.csv
+ */
+#include "ns3/core-module.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+static double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static std::vector<std::string> split(const std::string &list, char separator) {
+  std::vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, separator))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+// Value of 'column' in the summary.csv in 'dir', -1 if there is none
+static double read_summary(const std::string &dir, const std::string &column) {
+  FILE* f = fopen((dir + "/summary.csv").c_str(), "r");
+  if (f == 0)
+    return -1;
+  char header[1024], line[1024];
+  bool ok = fgets(header, sizeof(header), f) != 0 && fgets(line, sizeof(line), f) != 0;
+  fclose(f);
+  if (!ok)
+    return -1;
+  header[strcspn(header, "\r\n")] = 0;
+  line[strcspn(line, "\r\n")] = 0;
+  std::vector<std::string> names = split(header, ',');
+  std::vector<std::string> fields = split(line, ',');
+  for (size_t i = 0; i < names.size() && i < fields.size(); i++) {
+    if (names[i] == column)
+      return atof(fields[i].c_str());
+  }
+  return -1;
+}
+
+// Runs 'args' with the output going to dir/log.txt, returns the exit status
+static int run(const std::vector<std::string> &args, const std::string &dir, struct rusage &usage) {
+  // Or the child writes what is buffered again
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    FILE* log = freopen((dir + "/log.txt").c_str(), "w", stdout);
+    if (log != 0)
+      dup2(fileno(log), STDERR_FILENO);
+    std::vector<char*> argv;
+    for (size_t i = 0; i < args.size(); i++)
+      argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(0);
+    execv(argv[0], &argv[0]);
+    perror(argv[0]);
+    _exit(127);
+  }
+  int status = -1;
+  if (pid < 0 || wait4(pid, &status, 0, &usage) < 0)
+    return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char* argv[]) {
+  std::string bin = "../sms-main";
+  std::string out = "scaling";
+  std::string nodes = "25,100,500,2000";
+  double duration = 100;
+  uint32_t files = 100;
+  uint32_t maxFilesPerNode = 10;
+  double zipfExponent = 1.1;
+  double minX = -50, maxX = 50, minY = -50, maxY = 50;
+  bool scaleArea = true;
+  uint32_t seed = 1;
+  std::string extra = "";
+  CommandLine cmd;
+  cmd.AddValue("bin", "Simulator to run, sms-main or tools/sms-contact-sim", bin);
+  cmd.AddValue("out", "Directory for the output of the runs", out);
+  cmd.AddValue("nodes", "Comma separated node counts", nodes);
+  cmd.AddValue("duration", "Simulated seconds per run", duration);
+  cmd.AddValue("files", "Size of the file catalog", files);
+  cmd.AddValue("maxFilesPerNode", "Maximum number of files a node starts with", maxFilesPerNode);
+  cmd.AddValue("zipfExponent", "Exponent of the Zipf popularity of the files", zipfExponent);
+  cmd.AddValue("minX", "Left edge of the area of the first node count", minX);
+  cmd.AddValue("maxX", "Right edge of the area of the first node count", maxX);
+  cmd.AddValue("minY", "Bottom edge of the area of the first node count", minY);
+  cmd.AddValue("maxY", "Top edge of the area of the first node count", maxY);
+  cmd.AddValue("scaleArea", "Grow the area with the node count to keep the density", scaleArea);
+  cmd.AddValue("seed", "--RngRun of every run", seed);
+  cmd.AddValue("args", "Space separated extra arguments of every run", extra);
+  cmd.Parse(argc, argv);
+
+  std::vector<std::string> node_list = split(nodes, ',');
+  if (node_list.empty() || duration <= 2 || (mkdir(out.c_str(), 0755) != 0 && errno != EEXIST)) {
+    fprintf(stderr, "Need node counts, a duration of more than 2 s and a writable --out\n");
+    return 1;
+  }
+
+  printf("nodes,width,height,simulated_seconds,wall_seconds,wall_per_simulated_second,peak_rss_kb,events,"
+         "events_per_simulated_second,ns_per_event,us_per_node_second,kb_per_node,exponent\n");
+  double first_nodes = atof(node_list[0].c_str());
+  double previous_nodes = 0, previous_wall = 0;
+  bool failed = false;
+  for (size_t i = 0; i < node_list.size(); i++) {
+    double num_of_nodes = atof(node_list[i].c_str());
+    // The same density as the first scenario, around the same centre
+    double scale = scaleArea ? sqrt(num_of_nodes / first_nodes) : 1.0;
+    double cx = (minX + maxX) / 2, cy = (minY + maxY) / 2;
+    double width = (maxX - minX) * scale, height = (maxY - minY) * scale;
+
+    std::stringstream dir;
+    dir << out << "/n" << node_list[i];
+    mkdir(dir.str().c_str(), 0755);
+    std::vector<std::string> args;
+    args.push_back(bin);
+    std::stringstream a;
+    a << "--nodes=" << node_list[i] << " --duration=" << duration << " --files=" << files
+      << " --maxFilesPerNode=" << maxFilesPerNode << " --zipfExponent=" << zipfExponent
+      << " --minX=" << cx - width/2 << " --maxX=" << cx + width/2
+      << " --minY=" << cy - height/2 << " --maxY=" << cy + height/2
+      << " --randomPlacement=1 --stopOnConvergence=0 --metricsInterval=0 --RngRun=" << seed
+      << " --outputDir=" << dir.str() << " " << extra;
+    std::vector<std::string> more = split(a.str(), ' ');
+    args.insert(args.end(), more.begin(), more.end());
+
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    double start = now_s();
+    int status = run(args, dir.str(), usage);
+    double wall = now_s() - start;
+    // The applications only run from 2 s on
+    double simulated = read_summary(dir.str(), "stop_time") - 2.0;
+    double events = read_summary(dir.str(), "events");
+    if (status != 0 || simulated <= 0) {
+      fprintf(stderr, "%s failed, see %s/log.txt\n", bin.c_str(), dir.str().c_str());
+      failed = true;
+      continue;
+    }
+    double wall_per_second = wall / simulated;
+    printf("%s,%g,%g,%g,%.3f,%.5f,%ld,%.0f,%.0f,%.1f,%.3f,%.2f,", node_list[i].c_str(), width, height, simulated, wall,
+           wall_per_second, usage.ru_maxrss, events, events / simulated, events > 0 ? wall / events * 1e9 : 0,
+           wall_per_second / num_of_nodes * 1e6, usage.ru_maxrss / num_of_nodes);
+    if (previous_nodes > 0 && num_of_nodes != previous_nodes)
+      printf("%.2f", log(wall_per_second / previous_wall) / log(num_of_nodes / previous_nodes));
+    printf("\n");
+    fflush(stdout);
+    previous_nodes = num_of_nodes;
+    previous_wall = wall_per_second;
+  }
+  return failed ? 1 : 0;
+}
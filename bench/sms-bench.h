@@ -0,0 +1,76 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Shared pieces of the benchmarks: a monotonic clock, heap allocation
+ * counters and the Zipf(1.1) file popularity getInitialFileList uses.
+ *
+ * Include it from exactly one file per benchmark, it replaces malloc.
+ * Counting through __libc_malloc only works with glibc.
+ */
+#ifndef SMS_BENCH_H
+#define SMS_BENCH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <time.h>
+#include <vector>
+
+static uint64_t g_allocs = 0;
+static uint64_t g_alloc_bytes = 0;
+
+extern "C" void* __libc_malloc(size_t size);
+
+// operator new ends up here as well
+extern "C" void* malloc(size_t size) {
+  g_allocs++;
+  g_alloc_bytes += size;
+  return __libc_malloc(size);
+}
+
+static inline double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+/**
+ * \brief Time and heap use of a stretch of code, divided by the number of
+ * operations it did.
+ */
+class BenchTimer {
+public:
+  BenchTimer() : m_start(now_ns()), m_allocs(g_allocs), m_bytes(g_alloc_bytes) {}
+  double ns_per_op(uint64_t ops) const { return (now_ns() - m_start) / ops; }
+  double allocs_per_op(uint64_t ops) const { return (g_allocs - m_allocs) / (double) ops; }
+  double bytes_per_op(uint64_t ops) const { return (g_alloc_bytes - m_bytes) / (double) ops; }
+
+private:
+  double m_start;
+  uint64_t m_allocs;
+  uint64_t m_bytes;
+};
+
+/**
+ * \brief Draws file ids 1..catalog_size with Zipf(1.1) popularity.
+ */
+class ZipfSampler {
+public:
+  explicit ZipfSampler(uint32_t catalog_size) : m_cdf(catalog_size) {
+    double sum = 0;
+    for (uint32_t i = 0; i < catalog_size; i++) {
+      sum += 1.0 / std::pow(i + 1.0, 1.1);
+      m_cdf[i] = sum;
+    }
+  }
+
+  uint32_t next() const {
+    double u = (rand() / (RAND_MAX + 1.0)) * m_cdf.back();
+    return std::lower_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin() + 1;
+  }
+
+private:
+  std::vector<double> m_cdf;
+};
+
+#endif // SMS_BENCH_H
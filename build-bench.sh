@@ -0,0 +1,86 @@
+#!/bin/bash
+
+NS3_FLAGS="-pthread -DNS3_OPENMPI -DNS3_MPI -pthread -I/usr/include/ns3.17 -I/usr/lib/openmpi/include -I/usr/lib/openmpi/include/openmpi -I/usr/include/ns3.17 -L/usr//lib -L/usr/lib/openmpi/lib -lns3.17-wifi -lm -lns3.17-propagation -lns3.17-mobility -lns3.17-tools -lns3.17-stats -lns3.17-internet -lns3.17-bridge -lns3.17-mpi -pthread -lmpi_cxx -lmpi -ldl -lhwloc -lns3.17-network -lns3.17-core -lrt -lm"
+
+# Microbenchmarks for the protocol data structures, they don't need ns-3.
+g++ -O2 -march=native bench/sms-bench-bitmap.cc \
+  sms-chunk-bitmap.cc \
+  -o bench/sms-bench-bitmap
+
+g++ -O2 -march=native bench/sms-bench-rlnc.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  -o bench/sms-bench-rlnc
+
+g++ -O2 bench/sms-bench-grid.cc \
+  sms-spatial-grid.cc \
+  -o bench/sms-bench-grid
+
+g++ -O2 bench/sms-bench-codec.cc \
+  sms-adv-codec.cc \
+  -o bench/sms-bench-codec
+
+g++ -O2 bench/sms-bench-protocol.cc \
+  sms-protocol.cc \
+  sms-file.cc \
+  sms-log.cc \
+  sms-chunk-bitmap.cc \
+  sms-adv-codec.cc \
+  sms-event-trace.cc \
+  sms-neighbour-table.cc \
+  sms-dense-bitset.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  -o bench/sms-bench-protocol
+
+g++ -O2 bench/sms-bench-wire.cc \
+  sms-protocol.cc \
+  sms-file.cc \
+  sms-log.cc \
+  sms-chunk-bitmap.cc \
+  sms-adv-codec.cc \
+  sms-event-trace.cc \
+  sms-neighbour-table.cc \
+  sms-dense-bitset.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  -o bench/sms-bench-wire
+
+# These link against ns-3 like build.sh does.
+g++ -O2 bench/sms-bench-adv.cc \
+  sms-helpers.cc \
+  sms-file.cc \
+  sms-log.cc \
+  sms-protocol.cc \
+  sms-echo-client.cc \
+  sms-headers.cc \
+  sms-chunk-bitmap.cc \
+  sms-adv-codec.cc \
+  sms-event-trace.cc \
+  sms-neighbour-table.cc \
+  sms-dense-bitset.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  sms-channel-load.cc \
+  sms-lazy-timer.cc \
+  -o bench/sms-bench-adv \
+  $NS3_FLAGS
+
+g++ -O2 bench/sms-bench-headers.cc \
+  sms-headers.cc \
+  sms-protocol.cc \
+  sms-file.cc \
+  sms-log.cc \
+  sms-chunk-bitmap.cc \
+  sms-adv-codec.cc \
+  sms-event-trace.cc \
+  sms-neighbour-table.cc \
+  sms-dense-bitset.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  -o bench/sms-bench-headers \
+  $NS3_FLAGS
+
+g++ -O2 bench/sms-bench-scaling.cc \
+  -o bench/sms-bench-scaling \
+  $NS3_FLAGS
@@ -2,7 +2,51 @@
 
 g++ sms-main.cc \
   sms-helpers.cc \
+  sms-file.cc \
+  sms-log.cc \
+  sms-protocol.cc \
+  sms-headers.cc \
   sms-echo-client.cc \
   sms-echo-helper.cc \
+  sms-chunk-bitmap.cc \
+  sms-adv-codec.cc \
+  sms-event-trace.cc \
+  sms-neighbour-table.cc \
+  sms-dense-bitset.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  sms-channel-load.cc \
+  sms-lazy-timer.cc \
+  sms-metrics.cc \
+  sms-capture.cc \
+  sms-convergence.cc \
+  sms-distributed.cc \
   -o sms-main \
   -pthread -DNS3_OPENMPI -DNS3_MPI -pthread -I/usr/include/ns3.17 -I/usr/lib/openmpi/include -I/usr/lib/openmpi/include/openmpi -I/usr/include/ns3.17 -L/usr//lib -L/usr/lib/openmpi/lib -lns3.17-wifi -lm -lns3.17-propagation -lns3.17-mobility -lns3.17-tools -lns3.17-stats -lns3.17-internet -lns3.17-bridge -lns3.17-mpi -pthread -lmpi_cxx -lmpi -ldl -lhwloc -lns3.17-network -lns3.17-core -lrt -lm
+
+# Offline tools, they don't need ns-3
+g++ -O2 tools/sms-trace-decode.cc \
+  sms-event-trace.cc \
+  -o tools/sms-trace-decode
+
+g++ -O2 tools/sms-sweep.cc \
+  -o tools/sms-sweep
+
+g++ -O2 tools/sms-contact-sim.cc \
+  sms-protocol.cc \
+  sms-file.cc \
+  sms-log.cc \
+  sms-chunk-bitmap.cc \
+  sms-adv-codec.cc \
+  sms-event-trace.cc \
+  sms-neighbour-table.cc \
+  sms-dense-bitset.cc \
+  sms-gf256.cc \
+  sms-rlnc.cc \
+  sms-channel-load.cc \
+  sms-lazy-timer.cc \
+  sms-metrics.cc \
+  sms-capture.cc \
+  sms-convergence.cc \
+  sms-spatial-grid.cc \
+  -o tools/sms-contact-sim
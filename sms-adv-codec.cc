@@ -0,0 +1,183 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-adv-codec.h"
+#include <algorithm>
+
+// About 1% false positives
+#define BLOOM_BITS_PER_FILE 10
+#define BLOOM_NUM_OF_HASHES 7
+
+bool AdvEntry::operator<(const AdvEntry &other) const {
+  return file_id < other.file_id;
+}
+
+static void write_varint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t) (value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t) value);
+}
+
+static uint64_t mix(uint32_t file_id) {
+  // splitmix64 finalizer
+  uint64_t h = file_id + 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+  return h ^ (h >> 31);
+}
+
+static uint32_t bloom_bit(uint64_t hash, uint32_t i, uint32_t num_of_bits) {
+  uint32_t h1 = (uint32_t) hash;
+  uint32_t h2 = (uint32_t) (hash >> 32) | 1;
+  return (h1 + i*h2) % num_of_bits;
+}
+
+// Boyer-Moore majority vote, good enough to pick a size most files share
+static uint32_t common_size(const std::vector<AdvEntry> &files) {
+  uint32_t candidate = 0;
+  uint32_t votes = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (votes == 0) {
+      candidate = files[i].file_size;
+      votes = 1;
+    } else if (files[i].file_size == candidate) {
+      votes++;
+    } else {
+      votes--;
+    }
+  }
+  return candidate;
+}
+
+void adv_encode(std::vector<AdvEntry> &files, uint32_t bloom_threshold, uint32_t chunk_size, std::vector<uint8_t> &out) {
+  bool bloom = bloom_threshold != 0 && files.size() >= bloom_threshold;
+  out.clear();
+  out.push_back(0);
+  out.push_back((ADV_VERSION << 4) | (bloom ? ADV_MODE_BLOOM : ADV_MODE_LIST));
+  write_varint(out, chunk_size);
+  write_varint(out, files.size());
+  if (bloom) {
+    uint32_t num_of_bytes = (files.size()*BLOOM_BITS_PER_FILE + 7) / 8;
+    out.push_back(BLOOM_NUM_OF_HASHES);
+    write_varint(out, num_of_bytes);
+    size_t filter = out.size();
+    out.resize(filter + num_of_bytes, 0);
+    for (size_t i = 0; i < files.size(); i++) {
+      uint64_t hash = mix(files[i].file_id);
+      for (uint32_t k = 0; k < BLOOM_NUM_OF_HASHES; k++) {
+        uint32_t bit = bloom_bit(hash, k, num_of_bytes*8);
+        out[filter + bit/8] |= 1 << (bit & 7);
+      }
+    }
+    return;
+  }
+  std::sort(files.begin(), files.end());
+  uint32_t default_size = common_size(files);
+  write_varint(out, default_size);
+  uint32_t last_id = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    bool has_size = files[i].file_size != default_size;
+    write_varint(out, ((uint64_t) (files[i].file_id - last_id) << 1) | has_size);
+    if (has_size)
+      write_varint(out, files[i].file_size);
+    last_id = files[i].file_id;
+  }
+}
+
+AdvDecoder::AdvDecoder(const uint8_t* data, size_t length)
+  : m_pos(data)
+    , m_end(data + length)
+    , m_valid(false)
+    , m_mode(ADV_MODE_LIST)
+    , m_chunk_size(0)
+    , m_num_of_files(0)
+    , m_default_size(0)
+    , m_num_read(0)
+    , m_last_id(0)
+    , m_num_of_hashes(0)
+    , m_filter(0)
+    , m_filter_bits(0)
+{
+  if (length < ADV_HEADER_LENGTH || data[0] != 0 || (data[1] >> 4) != ADV_VERSION)
+    return;
+  m_mode = data[1] & 0x0F;
+  m_pos += ADV_HEADER_LENGTH;
+  if (!read_varint(m_chunk_size) || m_chunk_size == 0 || !read_varint(m_num_of_files))
+    return;
+  if (m_mode == ADV_MODE_LIST) {
+    // Every file takes at least one byte, a bigger count is corrupt
+    m_valid = read_varint(m_default_size) && m_num_of_files <= (size_t) (m_end - m_pos);
+  } else if (m_mode == ADV_MODE_BLOOM) {
+    uint32_t num_of_bytes;
+    if (m_pos == m_end)
+      return;
+    m_num_of_hashes = *m_pos++;
+    if (!read_varint(num_of_bytes) || num_of_bytes == 0 || (size_t) (m_end - m_pos) < num_of_bytes)
+      return;
+    m_filter = m_pos;
+    m_filter_bits = num_of_bytes*8;
+    m_valid = true;
+  }
+}
+
+bool AdvDecoder::read_varint(uint64_t &value) {
+  value = 0;
+  for (uint32_t shift = 0; shift < 64 && m_pos != m_end; shift += 7) {
+    uint8_t byte = *m_pos++;
+    value |= (uint64_t) (byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool AdvDecoder::read_varint(uint32_t &value) {
+  uint64_t wide;
+  if (!read_varint(wide) || wide > 0xFFFFFFFFULL)
+    return false;
+  value = (uint32_t) wide;
+  return true;
+}
+
+bool AdvDecoder::is_valid() const {
+  return m_valid;
+}
+
+uint8_t AdvDecoder::get_mode() const {
+  return m_mode;
+}
+
+uint32_t AdvDecoder::get_chunk_size() const {
+  return m_chunk_size;
+}
+
+uint32_t AdvDecoder::get_num_of_files() const {
+  return m_num_of_files;
+}
+
+bool AdvDecoder::next(AdvEntry &entry) {
+  if (!m_valid || m_mode != ADV_MODE_LIST || m_num_read == m_num_of_files)
+    return false;
+  uint64_t delta;
+  entry.file_size = m_default_size;
+  if (!read_varint(delta) || ((delta & 1) && !read_varint(entry.file_size))) {
+    m_valid = false;
+    return false;
+  }
+  m_last_id += (uint32_t) (delta >> 1);
+  entry.file_id = m_last_id;
+  m_num_read++;
+  return true;
+}
+
+bool AdvDecoder::may_contain(uint32_t file_id) const {
+  if (!m_valid || m_mode != ADV_MODE_BLOOM)
+    return false;
+  uint64_t hash = mix(file_id);
+  for (uint32_t k = 0; k < m_num_of_hashes; k++) {
+    uint32_t bit = bloom_bit(hash, k, m_filter_bits);
+    if (!(m_filter[bit/8] & (1 << (bit & 7))))
+      return false;
+  }
+  return true;
+}
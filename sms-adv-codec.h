@@ -0,0 +1,96 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_ADV_CODEC_H
+#define SMS_ADV_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Advertisement wire format, version 2. All integers are LEB128 varints.
+ *
+ *   uint8   packet type, 0 for advertisements
+ *   uint8   version << 4 | mode
+ *   varint  chunk size in bytes, the sender's files are split into chunks
+ *           of this size
+ *
+ * List mode (ADV_MODE_LIST):
+ *   varint  number of files
+ *   varint  default file size
+ *   per file, sorted by id:
+ *   varint  (id - previous id) << 1 | has_size
+ *   varint  file size, only if has_size
+ *
+ * Sizes are left out for files of the default size, which is the most
+ * common size among the advertised files.
+ *
+ * Bloom mode (ADV_MODE_BLOOM), for very large holdings:
+ *   varint  number of files
+ *   uint8   number of hash functions
+ *   varint  filter length in bytes, followed by the filter
+ *
+ * A Bloom summary only tells a receiver which of the files it already
+ * knows the sender has, it can't be used to learn about new files.
+ */
+
+#define ADV_VERSION 2
+#define ADV_MODE_LIST 0
+#define ADV_MODE_BLOOM 1
+// The fixed part of the header, before the chunk size
+#define ADV_HEADER_LENGTH 2
+
+struct AdvEntry {
+  uint32_t file_id;
+  uint32_t file_size;
+  bool operator<(const AdvEntry &other) const;
+};
+
+/**
+ * Encodes 'files' into 'out', replacing its content. 'files' is sorted in
+ * place. The Bloom mode is used when bloom_threshold is not zero and there
+ * are at least that many files.
+ */
+void adv_encode(std::vector<AdvEntry> &files, uint32_t bloom_threshold, uint32_t chunk_size, std::vector<uint8_t> &out);
+
+/**
+ * \brief Reads an advertisement in one pass.
+ *
+ * In list mode next() returns the files one by one, in Bloom mode
+ * may_contain() answers membership queries. Malformed input makes next()
+ * stop early and is_valid() return false.
+ */
+class AdvDecoder {
+public:
+  AdvDecoder(const uint8_t* data, size_t length);
+
+  bool is_valid() const;
+  uint8_t get_mode() const;
+  uint32_t get_chunk_size() const;
+  uint32_t get_num_of_files() const;
+
+  bool next(AdvEntry &entry);
+  bool may_contain(uint32_t file_id) const;
+
+private:
+  bool read_varint(uint64_t &value);
+  bool read_varint(uint32_t &value);
+
+  const uint8_t* m_pos;
+  const uint8_t* m_end;
+  bool m_valid;
+  uint8_t m_mode;
+  uint32_t m_chunk_size;
+  uint32_t m_num_of_files;
+
+  // List mode
+  uint32_t m_default_size;
+  uint32_t m_num_read;
+  uint32_t m_last_id;
+
+  // Bloom mode
+  uint8_t m_num_of_hashes;
+  const uint8_t* m_filter;
+  uint32_t m_filter_bits;
+};
+
+#endif // SMS_ADV_CODEC_H
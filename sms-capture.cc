@@ -0,0 +1,319 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-capture.h"
+#include "sms-protocol.h"
+#include <cstdlib>
+#include <cstring>
+
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+
+// pcapng block types and options
+#define PCAPNG_SECTION_HEADER 0x0A0D0D0Au
+#define PCAPNG_INTERFACE_DESCRIPTION 1
+#define PCAPNG_ENHANCED_PACKET 6
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4Du
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_COMMENT 1
+#define PCAPNG_IF_NAME 2
+#define PCAPNG_IF_TSRESOL 9
+#define PCAPNG_EPB_FLAGS 2
+
+// Blocks are built here and written in one go
+static std::vector<uint8_t> s_block;
+
+static void append(const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*) data;
+  s_block.insert(s_block.end(), bytes, bytes + length);
+}
+
+static void append_u16(uint16_t value) {
+  append(&value, sizeof(value));
+}
+
+static void append_u32(uint32_t value) {
+  append(&value, sizeof(value));
+}
+
+static void pad_block() {
+  while (s_block.size() % 4 != 0)
+    s_block.push_back(0);
+}
+
+static void append_option(uint16_t code, const void* data, size_t length) {
+  append_u16(code);
+  append_u16((uint16_t) length);
+  append(data, length);
+  pad_block();
+}
+
+// Starts a block of 'type', end_block() fills in its length
+static void begin_block(uint32_t type) {
+  s_block.clear();
+  append_u32(type);
+  append_u32(0);
+}
+
+static void end_block() {
+  uint32_t length = s_block.size() + 4;
+  memcpy(&s_block[4], &length, 4);
+  append_u32(length);
+}
+
+SmsCapture::SmsCapture()
+  : m_file(0)
+    , m_piped(false)
+    , m_types(0)
+    , m_start_ns(0)
+    , m_stop_ns((uint64_t) -1)
+    , m_snap_length(0)
+    , m_num_of_interfaces(0)
+    , m_ring_next(0)
+    , m_ring_count(0)
+    , m_num_of_frames(0)
+    , m_num_of_dumps(0)
+{
+}
+
+SmsCapture::~SmsCapture() {
+  close();
+}
+
+bool SmsCapture::set_nodes(const std::string &list) {
+  m_nodes.clear();
+  size_t begin = 0;
+  while (begin < list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string range = list.substr(begin, end - begin);
+    char* rest;
+    unsigned long first = strtoul(range.c_str(), &rest, 10);
+    unsigned long last = first;
+    if (*rest == '-')
+      last = strtoul(rest + 1, &rest, 10);
+    if (range.empty() || *rest != 0 || last < first)
+      return false;
+    if (last >= m_nodes.size())
+      m_nodes.resize(last + 1, 0);
+    for (unsigned long node = first; node <= last; node++)
+      m_nodes[node] = 1;
+    begin = end + 1;
+  }
+  return true;
+}
+
+bool SmsCapture::set_types(const std::string &list) {
+  m_types = 0;
+  size_t begin = 0;
+  while (begin < list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string name = list.substr(begin, end - begin);
+    uint8_t type = 0;
+    while (type < SMS_NUM_OF_PACKET_TYPES && name != sms_packet_type_name(type))
+      type++;
+    if (type == SMS_NUM_OF_PACKET_TYPES)
+      return false;
+    m_types |= 1u << type;
+    begin = end + 1;
+  }
+  return true;
+}
+
+void SmsCapture::set_window(double start, double stop) {
+  m_start_ns = start > 0 ? (uint64_t) (start * 1e9 + 0.5) : 0;
+  m_stop_ns = stop > 0 ? (uint64_t) (stop * 1e9 + 0.5) : (uint64_t) -1;
+}
+
+void SmsCapture::set_snap_length(uint32_t snap_length) {
+  m_snap_length = snap_length;
+}
+
+void SmsCapture::set_ring(uint32_t frames) {
+  m_ring.resize(frames);
+  m_ring_next = 0;
+  m_ring_count = 0;
+}
+
+void SmsCapture::set_triggers(const std::string &patterns) {
+  m_triggers.clear();
+  size_t begin = 0;
+  while (begin < patterns.size()) {
+    size_t end = patterns.find('|', begin);
+    if (end == std::string::npos)
+      end = patterns.size();
+    if (end > begin)
+      m_triggers.push_back(patterns.substr(begin, end - begin));
+    begin = end + 1;
+  }
+}
+
+bool SmsCapture::open(const std::string &path, bool compress) {
+  close();
+  if (compress) {
+    // gzip runs in its own process, next to the simulation
+    std::string quoted = "'";
+    for (size_t i = 0; i < path.size(); i++)
+      quoted += path[i] == '\'' ? std::string("'\\''") : std::string(1, path[i]);
+    quoted += "'";
+    m_file = popen(("gzip -1 > " + quoted).c_str(), "w");
+    m_piped = true;
+  } else {
+    m_file = fopen(path.c_str(), "wb");
+    m_piped = false;
+  }
+  if (m_file == 0)
+    return false;
+  m_buffer.resize(CAPTURE_BUFFER_SIZE);
+  setvbuf(m_file, &m_buffer[0], _IOFBF, m_buffer.size());
+  m_interfaces.clear();
+  m_num_of_interfaces = 0;
+  m_num_of_frames = 0;
+  m_num_of_dumps = 0;
+
+  begin_block(PCAPNG_SECTION_HEADER);
+  append_u32(PCAPNG_BYTE_ORDER_MAGIC);
+  append_u16(1);
+  append_u16(0);
+  // Section length unknown
+  append_u32(0xFFFFFFFFu);
+  append_u32(0xFFFFFFFFu);
+  end_block();
+  write(&s_block[0], s_block.size());
+  return true;
+}
+
+void SmsCapture::close() {
+  if (m_file == 0)
+    return;
+  if (m_piped)
+    pclose(m_file);
+  else
+    fclose(m_file);
+  m_file = 0;
+  m_ring_count = 0;
+}
+
+void SmsCapture::write(const void* data, size_t length) {
+  fwrite(data, 1, length, m_file);
+}
+
+uint32_t SmsCapture::get_interface(uint32_t node) {
+  if (node >= m_interfaces.size())
+    m_interfaces.resize(node + 1, 0);
+  if (m_interfaces[node] == 0) {
+    begin_block(PCAPNG_INTERFACE_DESCRIPTION);
+    append_u16(CAPTURE_LINKTYPE_IEEE802_11);
+    append_u16(0);
+    append_u32(m_snap_length);
+    char name[32];
+    int length = snprintf(name, sizeof(name), "node %u", node);
+    append_option(PCAPNG_IF_NAME, name, length);
+    // Nanoseconds
+    uint8_t resolution = 9;
+    append_option(PCAPNG_IF_TSRESOL, &resolution, 1);
+    append_option(PCAPNG_OPT_END, 0, 0);
+    end_block();
+    write(&s_block[0], s_block.size());
+    m_interfaces[node] = ++m_num_of_interfaces;
+  }
+  return m_interfaces[node] - 1;
+}
+
+void SmsCapture::write_frame(uint32_t node, uint8_t direction, uint64_t time_ns, const uint8_t* frame,
+                             uint32_t captured, uint32_t length, const std::string &comment) {
+  uint32_t interface = get_interface(node);
+  begin_block(PCAPNG_ENHANCED_PACKET);
+  append_u32(interface);
+  append_u32((uint32_t) (time_ns >> 32));
+  append_u32((uint32_t) time_ns);
+  append_u32(captured);
+  append_u32(length);
+  append(frame, captured);
+  pad_block();
+  uint32_t flags = direction;
+  append_option(PCAPNG_EPB_FLAGS, &flags, 4);
+  if (!comment.empty())
+    append_option(PCAPNG_OPT_COMMENT, comment.data(), comment.size());
+  append_option(PCAPNG_OPT_END, 0, 0);
+  end_block();
+  write(&s_block[0], s_block.size());
+  m_num_of_frames++;
+}
+
+void SmsCapture::add_frame(uint32_t node, Direction direction, uint64_t time_ns, const uint8_t* frame, uint32_t length) {
+  if (!is_wanted(node, time_ns))
+    return;
+  if (m_types != 0) {
+    int type = get_packet_type(frame, length);
+    if (type < 0 || !(m_types & (1u << type)))
+      return;
+  }
+  uint32_t captured = m_snap_length != 0 && length > m_snap_length ? m_snap_length : length;
+  if (m_ring.empty()) {
+    write_frame(node, direction, time_ns, frame, captured, length, std::string());
+    return;
+  }
+  RingFrame &slot = m_ring[m_ring_next];
+  slot.node = node;
+  slot.direction = direction;
+  slot.time_ns = time_ns;
+  slot.length = length;
+  slot.data.assign(frame, frame + captured);
+  m_ring_next = (m_ring_next + 1) % m_ring.size();
+  if (m_ring_count < m_ring.size())
+    m_ring_count++;
+}
+
+bool SmsCapture::on_warning(uint64_t time_ns, const std::string &message) {
+  if (m_file == 0 || m_ring_count == 0 || time_ns < m_start_ns || time_ns >= m_stop_ns)
+    return false;
+  size_t i = 0;
+  while (i < m_triggers.size() && message.find(m_triggers[i]) == std::string::npos)
+    i++;
+  if (i == m_triggers.size())
+    return false;
+  uint32_t index = (m_ring_next + m_ring.size() - m_ring_count) % m_ring.size();
+  for (; m_ring_count > 0; m_ring_count--) {
+    const RingFrame &slot = m_ring[index];
+    write_frame(slot.node, slot.direction, slot.time_ns, slot.data.empty() ? 0 : &slot.data[0], slot.data.size(),
+                slot.length, m_ring_count == 1 ? message : std::string());
+    index = (index + 1) % m_ring.size();
+  }
+  // Whatever happens to the run later, the frames before the warning are
+  // on disk
+  fflush(m_file);
+  m_num_of_dumps++;
+  return true;
+}
+
+int SmsCapture::get_packet_type(const uint8_t* frame, uint32_t length) {
+  if (length < 24)
+    return -1;
+  uint16_t control = frame[0] | (frame[1] << 8);
+  uint8_t type = (control >> 2) & 3;
+  uint8_t subtype = (control >> 4) & 0xF;
+  // Data frames that carry data
+  if (type != 2 || (subtype & 4))
+    return -1;
+  uint32_t offset = 24;
+  // Both to and from DS: a fourth address
+  if (((control >> 8) & 3) == 3)
+    offset += 6;
+  // QoS control
+  if (subtype & 8)
+    offset += 2;
+  // LLC/SNAP with IPv4
+  if (length < offset + 8 || frame[offset] != 0xAA || frame[offset + 1] != 0xAA || frame[offset + 2] != 0x03 ||
+      frame[offset + 6] != 0x08 || frame[offset + 7] != 0x00)
+    return -1;
+  offset += 8;
+  if (length < offset + 20 || (frame[offset] >> 4) != 4 || frame[offset + 9] != 17)
+    return -1;
+  offset += (frame[offset] & 0xF) * 4;
+  // UDP
+  offset += 8;
+  if (length <= offset)
+    return -1;
+  return frame[offset];
+}
@@ -0,0 +1,157 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_CAPTURE_H
+#define SMS_CAPTURE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Filtered packet capture into a single pcapng file.
+ *
+ * The drivers hand over the 802.11 frames their nodes send and receive.
+ * Every node gets its own interface in the file, named "node <id>", and
+ * every frame is marked inbound or outbound, so one file holds what any
+ * number of nodes saw. Frames can be restricted to a set of nodes, a time
+ * window and the packet types of the protocol, and cut to a snap length.
+ *
+ * In ring mode the last frames are only kept in memory. A warning of the
+ * protocol that contains one of the trigger patterns writes them out, the
+ * last one with the warning as its comment.
+ *
+ * The file can be piped through gzip, Wireshark reads it compressed.
+ */
+
+#define CAPTURE_LINKTYPE_IEEE802_11 105
+// Warnings about packets that shouldn't exist
+#define SMS_CAPTURE_TRIGGERS "Malformed|Truncated|cut short|weird packet type|past the end"
+
+class SmsCapture {
+public:
+  enum Direction {
+    CAPTURE_INBOUND = 1,
+    CAPTURE_OUTBOUND = 2
+  };
+
+  SmsCapture();
+  ~SmsCapture();
+
+  // Filters, before open()
+
+  /**
+   * Node ids and ranges like "0-9,20", empty for all nodes.
+   */
+  bool set_nodes(const std::string &list);
+  /**
+   * Packet type names like "request,reply" (see sms_packet_type_name()),
+   * empty for all frames. With a list, frames that aren't packets of the
+   * protocol are left out.
+   */
+  bool set_types(const std::string &list);
+  /**
+   * Simulated seconds, a stop of 0 or less for no end.
+   */
+  void set_window(double start, double stop);
+  /**
+   * Bytes kept of each frame, 0 for all.
+   */
+  void set_snap_length(uint32_t snap_length);
+  /**
+   * Keeps the last 'frames' frames in memory instead of writing them all,
+   * 0 to write them all.
+   */
+  void set_ring(uint32_t frames);
+  /**
+   * '|' separated patterns, a warning containing one of them dumps the
+   * ring.
+   */
+  void set_triggers(const std::string &patterns);
+
+  /**
+   * Creates the file, piping it through "gzip -1" with 'compress'.
+   */
+  bool open(const std::string &path, bool compress);
+  void close();
+  bool is_open() const;
+
+  /**
+   * Whether a frame of 'node' at 'time_ns' passes the node and time
+   * filters, to save copying those that don't.
+   */
+  bool is_wanted(uint32_t node, uint64_t time_ns) const;
+  void add_frame(uint32_t node, Direction direction, uint64_t time_ns, const uint8_t* frame, uint32_t length);
+
+  /**
+   * In ring mode, writes the frames kept if 'message' contains a trigger
+   * pattern. Returns whether it did.
+   */
+  bool on_warning(uint64_t time_ns, const std::string &message);
+
+  uint64_t get_num_of_frames() const;
+  uint32_t get_num_of_dumps() const;
+
+  /**
+   * The packet type of a data frame carrying UDP over IPv4, -1 for other
+   * frames.
+   */
+  static int get_packet_type(const uint8_t* frame, uint32_t length);
+
+private:
+  struct RingFrame {
+    uint32_t node;
+    uint8_t direction;
+    uint64_t time_ns;
+    uint32_t length;
+    std::vector<uint8_t> data;
+  };
+
+  void write(const void* data, size_t length);
+  void write_frame(uint32_t node, uint8_t direction, uint64_t time_ns, const uint8_t* frame, uint32_t captured,
+                   uint32_t length, const std::string &comment);
+  uint32_t get_interface(uint32_t node);
+
+  FILE* m_file;
+  bool m_piped;
+  std::vector<char> m_buffer;
+
+  // Node filter by id, empty for all nodes
+  std::vector<uint8_t> m_nodes;
+  // Bit per packet type, 0 for all frames
+  uint32_t m_types;
+  uint64_t m_start_ns;
+  uint64_t m_stop_ns;
+  uint32_t m_snap_length;
+  std::vector<std::string> m_triggers;
+
+  // Interface of each node id plus 1, 0 until its first frame is written
+  std::vector<uint32_t> m_interfaces;
+  uint32_t m_num_of_interfaces;
+
+  std::vector<RingFrame> m_ring;
+  // Next slot to fill and frames kept
+  uint32_t m_ring_next;
+  uint32_t m_ring_count;
+
+  uint64_t m_num_of_frames;
+  uint32_t m_num_of_dumps;
+};
+
+inline bool SmsCapture::is_open() const {
+  return m_file != 0;
+}
+
+inline bool SmsCapture::is_wanted(uint32_t node, uint64_t time_ns) const {
+  return m_file != 0 && time_ns >= m_start_ns && time_ns < m_stop_ns &&
+    (m_nodes.empty() || (node < m_nodes.size() && m_nodes[node]));
+}
+
+inline uint64_t SmsCapture::get_num_of_frames() const {
+  return m_num_of_frames;
+}
+
+inline uint32_t SmsCapture::get_num_of_dumps() const {
+  return m_num_of_dumps;
+}
+
+#endif // SMS_CAPTURE_H
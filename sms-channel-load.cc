@@ -0,0 +1,30 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-channel-load.h"
+#include <cmath>
+
+ChannelLoad::ChannelLoad(double window) : m_window(window), m_busy(0), m_last(0) {
+}
+
+void ChannelLoad::add_busy(double start, double duration) {
+  double end = start + duration;
+  if (end <= m_last)
+    return;
+  if (start > m_last) {
+    // Idle since the last busy period
+    m_busy *= std::exp((m_last - start) / m_window);
+    m_last = start;
+  }
+  m_busy = 1 - (1 - m_busy) * std::exp((m_last - end) / m_window);
+  m_last = end;
+}
+
+double ChannelLoad::get_busy(double now) const {
+  if (now <= m_last)
+    return m_busy;
+  return m_busy * std::exp((m_last - now) / m_window);
+}
+
+void ChannelLoad::clear() {
+  m_busy = 0;
+  m_last = 0;
+}
@@ -0,0 +1,37 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_CHANNEL_LOAD_H
+#define SMS_CHANNEL_LOAD_H
+
+/**
+ * \brief Share of the recent airtime a node found the channel busy.
+ *
+ * An exponentially weighted moving average of the busy indicator (sending,
+ * receiving or sensing a carrier) with a time constant of 'window' seconds.
+ * Busy periods are added as the radio reports them. Parts of a period that
+ * overlap the previous ones are only counted once, so periods reported
+ * slightly out of order are fine. Updates and queries are O(1).
+ */
+class ChannelLoad {
+public:
+  explicit ChannelLoad(double window = 0.1);
+
+  /**
+   * The channel was busy for 'duration' seconds from 'start' on.
+   */
+  void add_busy(double start, double duration);
+
+  /**
+   * Busy share in [0, 1] as of 'now'.
+   */
+  double get_busy(double now) const;
+
+  void clear();
+
+private:
+  double m_window;
+  double m_busy;
+  // End of the last busy period, m_busy is the average at that time
+  double m_last;
+};
+
+#endif // SMS_CHANNEL_LOAD_H
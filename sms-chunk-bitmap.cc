@@ -0,0 +1,95 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-chunk-bitmap.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define ALL_ONES (~(uint64_t) 0)
+
+// Below this many words the plain loop is as fast as the vector one
+#define SIMD_MIN_WORDS 8
+
+ChunkBitmap::ChunkBitmap() : m_size(0) {
+}
+
+ChunkBitmap::ChunkBitmap(uint32_t num_of_bits, bool value)
+  : m_words((num_of_bits + 63) / 64, value ? ALL_ONES : 0)
+    , m_size(num_of_bits)
+{
+  if (!value && (num_of_bits & 63)) {
+    m_words.back() = ALL_ONES << (num_of_bits & 63);
+  }
+}
+
+uint32_t ChunkBitmap::find_zero_word(uint32_t first_word) const {
+  const uint64_t* p = words();
+  uint32_t n = m_words.size();
+  uint32_t w = first_word;
+#if defined(__AVX2__)
+  if (n - w >= SIMD_MIN_WORDS) {
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    for (; w + 4 <= n; w += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i*) (p + w));
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, ones)) != -1)
+        break;
+    }
+  }
+#elif defined(__SSE2__)
+  if (n - w >= SIMD_MIN_WORDS) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (; w + 2 <= n; w += 2) {
+      __m128i v = _mm_loadu_si128((const __m128i*) (p + w));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, ones)) != 0xFFFF)
+        break;
+    }
+  }
+#endif
+  for (; w < n; w++) {
+    if (p[w] != ALL_ONES)
+      return w;
+  }
+  return n;
+}
+
+uint32_t ChunkBitmap::find_first_zero() const {
+  uint32_t w = find_zero_word(0);
+  if (w == m_words.size())
+    return m_size;
+  return w*64 + __builtin_ctzll(~m_words[w]);
+}
+
+uint32_t ChunkBitmap::find_next_zero(uint32_t from) const {
+  if (from >= m_size)
+    return m_size;
+  uint32_t w = from >> 6;
+  // Pretend the bits before 'from' in its word are set
+  uint64_t word = m_words[w] | ~(ALL_ONES << (from & 63));
+  if (word != ALL_ONES)
+    return w*64 + __builtin_ctzll(~word);
+  w = find_zero_word(w+1);
+  if (w == m_words.size())
+    return m_size;
+  return w*64 + __builtin_ctzll(~m_words[w]);
+}
+
+uint32_t ChunkBitmap::count_zeros(uint32_t begin, uint32_t end) const {
+  if (end > m_size)
+    end = m_size;
+  if (begin >= end)
+    return 0;
+  uint32_t first = begin >> 6;
+  uint32_t last = (end - 1) >> 6;
+  uint64_t head_mask = ALL_ONES << (begin & 63);
+  uint64_t tail_mask = ALL_ONES >> (63 - ((end - 1) & 63));
+  if (first == last)
+    return __builtin_popcountll(~m_words[first] & head_mask & tail_mask);
+  uint32_t zeros = __builtin_popcountll(~m_words[first] & head_mask);
+  for (uint32_t w = first+1; w < last; w++) {
+    zeros += __builtin_popcountll(~m_words[w]);
+  }
+  zeros += __builtin_popcountll(~m_words[last] & tail_mask);
+  return zeros;
+}
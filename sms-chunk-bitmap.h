@@ -0,0 +1,75 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_CHUNK_BITMAP_H
+#define SMS_CHUNK_BITMAP_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \brief Fixed-size bitmap packed into 64-bit words.
+ *
+ * Bit i is set when chunk i is present. The unused bits of the last word
+ * are always kept set, so a word that isn't all ones is guaranteed to hold
+ * a real missing chunk and the searches never have to mask the tail.
+ */
+class ChunkBitmap {
+public:
+  ChunkBitmap();
+  ChunkBitmap(uint32_t num_of_bits, bool value);
+
+  uint32_t size() const;
+  uint32_t num_of_words() const;
+  const uint64_t* words() const;
+
+  bool test(uint32_t i) const;
+  void set(uint32_t i);
+  void reset(uint32_t i);
+
+  /**
+   * Returns the index of the first zero bit, or size() if all bits are set.
+   */
+  uint32_t find_first_zero() const;
+
+  /**
+   * Returns the index of the first zero bit at or after 'from', or size()
+   * if there is none.
+   */
+  uint32_t find_next_zero(uint32_t from) const;
+
+  /**
+   * Returns the number of zero bits in [begin, end).
+   */
+  uint32_t count_zeros(uint32_t begin, uint32_t end) const;
+
+private:
+  uint32_t find_zero_word(uint32_t first_word) const;
+
+  std::vector<uint64_t> m_words;
+  uint32_t m_size;
+};
+
+inline uint32_t ChunkBitmap::size() const {
+  return m_size;
+}
+
+inline uint32_t ChunkBitmap::num_of_words() const {
+  return m_words.size();
+}
+
+inline const uint64_t* ChunkBitmap::words() const {
+  return m_words.empty() ? 0 : &m_words[0];
+}
+
+inline bool ChunkBitmap::test(uint32_t i) const {
+  return (m_words[i >> 6] >> (i & 63)) & 1;
+}
+
+inline void ChunkBitmap::set(uint32_t i) {
+  m_words[i >> 6] |= ((uint64_t) 1) << (i & 63);
+}
+
+inline void ChunkBitmap::reset(uint32_t i) {
+  m_words[i >> 6] &= ~(((uint64_t) 1) << (i & 63));
+}
+
+#endif // SMS_CHUNK_BITMAP_H
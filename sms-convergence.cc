@@ -0,0 +1,50 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-convergence.h"
+
+SmsConvergence::SmsConvergence()
+  : m_num_of_files(0)
+    , m_stall_window(0)
+    , m_full_files(0)
+    , m_received_chunks(0)
+    , m_last_progress(-1)
+    , m_state(CONVERGENCE_RUNNING)
+{
+}
+
+void SmsConvergence::set_stall_window(double seconds) {
+  m_stall_window = seconds;
+}
+
+void SmsConvergence::add_node(const SmsProtocol* node) {
+  m_nodes.push_back(node);
+  const std::vector<uint32_t> &full = node->files.full_files();
+  for (size_t i = 0; i < full.size(); i++) {
+    uint32_t file_id = node->files[full[i]].getFileId();
+    if (file_id >= m_is_initial.size())
+      m_is_initial.resize(file_id + 1, 0);
+    if (!m_is_initial[file_id]) {
+      m_is_initial[file_id] = 1;
+      m_num_of_files++;
+    }
+  }
+}
+
+SmsConvergence::State SmsConvergence::check(double now) {
+  if (m_state != CONVERGENCE_RUNNING)
+    return m_state;
+  uint64_t full_files = 0, received_chunks = 0;
+  for (size_t i = 0; i < m_nodes.size(); i++) {
+    full_files += m_nodes[i]->GetNumOfFullFiles();
+    received_chunks += m_nodes[i]->GetNumOfReceivedChunks();
+  }
+  m_full_files = full_files;
+  if (received_chunks != m_received_chunks || m_last_progress < 0) {
+    m_received_chunks = received_chunks;
+    m_last_progress = now;
+  }
+  if (full_files >= get_num_of_full_files_needed())
+    m_state = CONVERGENCE_CONVERGED;
+  else if (m_stall_window > 0 && now - m_last_progress >= m_stall_window)
+    m_state = CONVERGENCE_STALLED;
+  return m_state;
+}
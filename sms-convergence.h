@@ -0,0 +1,84 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_CONVERGENCE_H
+#define SMS_CONVERGENCE_H
+
+#include "sms-protocol.h"
+#include <stdint.h>
+#include <vector>
+
+// Simulated seconds between two checks of the drivers
+#define CONVERGENCE_CHECK_INTERVAL 1.0
+
+/**
+ * \brief Tells when a run can stop because no node can gain anything more.
+ *
+ * Nodes start with complete files and only ever add chunks, so once every
+ * node holds every file any of them started with, nothing changes anymore:
+ * the run has converged. Nodes that never meet the holders of a file keep
+ * a run from converging; with a stall window it also ends when no node
+ * gained a chunk for that long.
+ *
+ * A check sums the counters of the nodes, O(nodes).
+ */
+class SmsConvergence {
+public:
+  enum State {
+    CONVERGENCE_RUNNING,
+    CONVERGENCE_CONVERGED,
+    CONVERGENCE_STALLED
+  };
+
+  SmsConvergence();
+
+  /**
+   * Simulated seconds without a new chunk after which check() reports a
+   * stall, 0 to wait for convergence only.
+   */
+  void set_stall_window(double seconds);
+
+  /**
+   * Adds a node once its initial files are set. It has to stay where it is
+   * as long as check() is called.
+   */
+  void add_node(const SmsProtocol* node);
+
+  State check(double now);
+  State get_state() const;
+
+  // Files held completely by all nodes together, and how many of them are
+  // needed for convergence
+  uint64_t get_num_of_full_files() const;
+  uint64_t get_num_of_full_files_needed() const;
+  // Time of the first check that saw the current number of chunks gained
+  double get_last_progress() const;
+
+private:
+  std::vector<const SmsProtocol*> m_nodes;
+  // Every file id any node started with
+  std::vector<uint8_t> m_is_initial;
+  uint32_t m_num_of_files;
+
+  double m_stall_window;
+  uint64_t m_full_files;
+  uint64_t m_received_chunks;
+  double m_last_progress;
+  State m_state;
+};
+
+inline SmsConvergence::State SmsConvergence::get_state() const {
+  return m_state;
+}
+
+inline uint64_t SmsConvergence::get_num_of_full_files() const {
+  return m_full_files;
+}
+
+inline uint64_t SmsConvergence::get_num_of_full_files_needed() const {
+  return (uint64_t) m_nodes.size() * m_num_of_files;
+}
+
+inline double SmsConvergence::get_last_progress() const {
+  return m_last_progress;
+}
+
+#endif // SMS_CONVERGENCE_H
@@ -0,0 +1,54 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-dense-bitset.h"
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+DenseBitset::DenseBitset() {
+}
+
+void DenseBitset::clear() {
+  m_words.clear();
+}
+
+uint32_t DenseBitset::count() const {
+  uint32_t n = 0;
+  for (size_t w = 0; w < m_words.size(); w++)
+    n += __builtin_popcountll(m_words[w]);
+  return n;
+}
+
+uint32_t DenseBitset::count_and(const DenseBitset &other) const {
+  size_t num_of_words = MIN(m_words.size(), other.m_words.size());
+  uint32_t n = 0;
+  for (size_t w = 0; w < num_of_words; w++)
+    n += __builtin_popcountll(m_words[w] & other.m_words[w]);
+  return n;
+}
+
+int32_t DenseBitset::find_next(uint32_t from) const {
+  size_t w = from >> 6;
+  if (w >= m_words.size())
+    return -1;
+  // Drop the bits below 'from' in its word
+  uint64_t word = m_words[w] & (~(uint64_t) 0 << (from & 63));
+  while (word == 0) {
+    if (++w == m_words.size())
+      return -1;
+    word = m_words[w];
+  }
+  return (w << 6) + __builtin_ctzll(word);
+}
+
+int32_t DenseBitset::find_next_and(const DenseBitset &other, uint32_t from) const {
+  size_t num_of_words = MIN(m_words.size(), other.m_words.size());
+  size_t w = from >> 6;
+  if (w >= num_of_words)
+    return -1;
+  uint64_t word = m_words[w] & other.m_words[w] & (~(uint64_t) 0 << (from & 63));
+  while (word == 0) {
+    if (++w == num_of_words)
+      return -1;
+    word = m_words[w] & other.m_words[w];
+  }
+  return (w << 6) + __builtin_ctzll(word);
+}
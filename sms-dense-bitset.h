@@ -0,0 +1,76 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_DENSE_BITSET_H
+#define SMS_DENSE_BITSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \brief Growable set of small integers packed into 64-bit words.
+ *
+ * Used for sets of neighbour indices and of file slots. Bits past the end
+ * read as zero and set() grows the set as needed, so two sets of different
+ * sizes can be combined directly.
+ */
+class DenseBitset {
+public:
+  DenseBitset();
+
+  uint32_t num_of_words() const;
+  const uint64_t* words() const;
+
+  bool test(uint32_t i) const;
+  void set(uint32_t i);
+  void reset(uint32_t i);
+  void clear();
+
+  /**
+   * Returns the number of bits set.
+   */
+  uint32_t count() const;
+
+  /**
+   * Returns the number of bits set both here and in 'other'.
+   */
+  uint32_t count_and(const DenseBitset &other) const;
+
+  /**
+   * Returns the first bit set at or after 'from', or -1.
+   */
+  int32_t find_next(uint32_t from) const;
+
+  /**
+   * Returns the first bit set both here and in 'other' at or after 'from',
+   * or -1.
+   */
+  int32_t find_next_and(const DenseBitset &other, uint32_t from) const;
+
+private:
+  std::vector<uint64_t> m_words;
+};
+
+inline uint32_t DenseBitset::num_of_words() const {
+  return m_words.size();
+}
+
+inline const uint64_t* DenseBitset::words() const {
+  return m_words.empty() ? 0 : &m_words[0];
+}
+
+inline bool DenseBitset::test(uint32_t i) const {
+  return (i >> 6) < m_words.size() && ((m_words[i >> 6] >> (i & 63)) & 1);
+}
+
+inline void DenseBitset::set(uint32_t i) {
+  if ((i >> 6) >= m_words.size())
+    m_words.resize((i >> 6) + 1, 0);
+  m_words[i >> 6] |= ((uint64_t) 1) << (i & 63);
+}
+
+inline void DenseBitset::reset(uint32_t i) {
+  if ((i >> 6) < m_words.size())
+    m_words[i >> 6] &= ~(((uint64_t) 1) << (i & 63));
+}
+
+#endif // SMS_DENSE_BITSET_H
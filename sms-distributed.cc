@@ -0,0 +1,125 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-distributed.h"
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#include <mpi.h>
+#endif
+
+SmsPartition::SmsPartition()
+  : m_rank(0)
+    , m_num_of_ranks(1)
+    , m_total_nodes(0)
+{
+}
+
+void SmsPartition::enable(int* argc, char*** argv) {
+#ifdef NS3_MPI
+  MpiInterface::Enable(argc, argv);
+  m_rank = MpiInterface::GetSystemId();
+  m_num_of_ranks = MpiInterface::GetSize();
+#endif
+}
+
+void SmsPartition::disable() {
+#ifdef NS3_MPI
+  MpiInterface::Disable();
+#endif
+}
+
+void SmsPartition::apply(SmsScenario &scenario) {
+  m_total_nodes = scenario.numOfNodes;
+  if (!is_distributed())
+    return;
+  double width = (scenario.maxX - scenario.minX) / m_num_of_ranks;
+  scenario.minX += m_rank*width;
+  scenario.maxX = scenario.minX + width;
+  // The grid only covers a corner of the area, spread the nodes over the strip
+  scenario.randomPlacement = true;
+  scenario.numOfNodes = get_num_of_nodes();
+}
+
+bool SmsPartition::is_distributed() const {
+  return m_num_of_ranks > 1;
+}
+
+bool SmsPartition::is_root() const {
+  return m_rank == 0;
+}
+
+uint32_t SmsPartition::get_rank() const {
+  return m_rank;
+}
+
+uint32_t SmsPartition::get_num_of_ranks() const {
+  return m_num_of_ranks;
+}
+
+uint32_t SmsPartition::get_total_nodes() const {
+  return m_total_nodes;
+}
+
+uint32_t SmsPartition::get_first_node() const {
+  // The first total % ranks ranks get one node more
+  uint32_t share = m_total_nodes / m_num_of_ranks;
+  uint32_t rest = m_total_nodes % m_num_of_ranks;
+  return m_rank*share + std::min(m_rank, rest);
+}
+
+uint32_t SmsPartition::get_num_of_nodes() const {
+  return m_total_nodes / m_num_of_ranks + (m_rank < m_total_nodes % m_num_of_ranks ? 1 : 0);
+}
+
+uint32_t SmsPartition::get_rank_of_node(uint32_t node) const {
+  uint32_t share = m_total_nodes / m_num_of_ranks;
+  uint32_t rest = m_total_nodes % m_num_of_ranks;
+  if (node < rest*(share + 1))
+    return node / (share + 1);
+  return rest + (node - rest*(share + 1)) / share;
+}
+
+void SmsPartition::gather(const std::vector<uint32_t> &local, std::vector<uint32_t> &on_root) const {
+  if (!is_distributed()) {
+    on_root.insert(on_root.end(), local.begin(), local.end());
+    return;
+  }
+#ifdef NS3_MPI
+  int count = local.size();
+  std::vector<int> counts(m_num_of_ranks);
+  MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+  std::vector<int> offsets(m_num_of_ranks, 0);
+  int total = 0;
+  for (uint32_t i = 0; i < m_num_of_ranks; i++) {
+    offsets[i] = total;
+    total += counts[i];
+  }
+  std::vector<uint32_t> all(is_root() ? total + 1 : 1);
+  // MPI wants a valid pointer even for empty buffers
+  uint32_t dummy = 0;
+  MPI_Gatherv(local.empty() ? &dummy : const_cast<uint32_t*>(&local[0]), count, MPI_UNSIGNED,
+              &all[0], &counts[0], &offsets[0], MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+  if (is_root())
+    on_root.insert(on_root.end(), all.begin(), all.begin() + total);
+#endif
+}
+
+double SmsPartition::max(double value) const {
+#ifdef NS3_MPI
+  if (is_distributed()) {
+    double result = value;
+    MPI_Reduce(&value, &result, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    return result;
+  }
+#endif
+  return value;
+}
+
+double SmsPartition::sum(double value) const {
+#ifdef NS3_MPI
+  if (is_distributed()) {
+    double result = value;
+    MPI_Reduce(&value, &result, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    return result;
+  }
+#endif
+  return value;
+}
@@ -0,0 +1,71 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_DISTRIBUTED_H
+#define SMS_DISTRIBUTED_H
+
+#include "sms-helpers.h"
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Distributed mode: started with mpirun -np N, every rank simulates its own
+ * vertical strip of the mobility area with its share of the nodes.
+ *
+ * ns-3 can only split a simulation along point-to-point links, a wifi
+ * channel has to live in one process. The strips are therefore simulated
+ * independently: nodes keep to their strip and never hear nodes of other
+ * ranks. This is a spatial decomposition of the scenario, not an exact
+ * parallel version of the single process run.
+ *
+ * The initial file lists are drawn for all nodes on every rank, so every
+ * node starts with the same files whatever the number of ranks. Results
+ * are collected on rank 0.
+ */
+
+/**
+ * \brief This process' share of the scenario and the collective operations
+ * needed to put the results back together.
+ *
+ * Without NS3_MPI, or with a single rank, everything stays in this process
+ * and the collective operations are no-ops.
+ */
+class SmsPartition {
+public:
+  SmsPartition();
+
+  /**
+   * Starts MPI, must be called before the command line is parsed.
+   */
+  void enable(int* argc, char*** argv);
+  void disable();
+
+  /**
+   * Restricts 'scenario' to this rank's strip and nodes. The total number
+   * of nodes is read from the scenario.
+   */
+  void apply(SmsScenario &scenario);
+
+  bool is_distributed() const;
+  bool is_root() const;
+  uint32_t get_rank() const;
+  uint32_t get_num_of_ranks() const;
+  uint32_t get_total_nodes() const;
+  // Global id of this rank's first node, nodes are numbered rank by rank
+  uint32_t get_first_node() const;
+  uint32_t get_num_of_nodes() const;
+  uint32_t get_rank_of_node(uint32_t node) const;
+
+  /**
+   * Appends the 'local' values of all ranks, in rank order, to 'on_root'
+   * on rank 0. Collective: every rank has to call it.
+   */
+  void gather(const std::vector<uint32_t> &local, std::vector<uint32_t> &on_root) const;
+  double max(double value) const;
+  double sum(double value) const;
+
+private:
+  uint32_t m_rank;
+  uint32_t m_num_of_ranks;
+  uint32_t m_total_nodes;
+};
+
+#endif // SMS_DISTRIBUTED_H
@@ -24,41 +24,29 @@
 #include "ns3/ptr.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/traced-callback.h"
+#include "ns3/traced-value.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/wifi-phy.h"
+#include "sms-channel-load.h"
+#include "sms-lazy-timer.h"
 #include "sms-helpers.h"
-
-#define CHUNK_SIZE 1450
+#include "sms-protocol.h"
 
 namespace ns3 {
 
 class Socket;
 class Packet;
 
-class FileSMSChunks : public FileSMS {
-public:
-  FileSMSChunks(unsigned int id, size_t size, bool i_have_full_file);
-
-  std::vector<bool> chunks;
-  uint16_t size_of_last_chunk;
-  uint32_t file_size_in_chunks;
-  uint32_t num_of_received_chunks;
-  std::vector<Ipv4Address> nodes_who_have_file;
-
-  uint32_t get_first_missing_chunk();
-  uint32_t get_num_of_missing_chunks ();
-  uint16_t get_size_of_chunk(uint32_t chunk_id);
-  void add_node_to_seen_list(Ipv4Address node);
-  bool seen_in_node(Ipv4Address node);
-  double get_popularity(uint32_t total_number_of_nodes);
-  bool is_full();
-};
-
 /**
  * \ingroup udpecho
  * \brief A Udp Echo client
  *
  * Every packet sent should be returned by the server and received here.
+ *
+ * Runs the SmsProtocol of one node on top of a broadcast UDP socket and
+ * ns-3 events.
  */
-class SmsEchoClient : public Application
+class SmsEchoClient : public Application, public SmsProtocolHost
 {
 public:
   static TypeId GetTypeId (void);
@@ -67,47 +55,46 @@ public:
 
   virtual ~SmsEchoClient ();
 
-  std::vector<FileSMSChunks> files;
-
-  void cancel_all_events();
-  double get_time_advertisement(bool start);
-  double get_time_request();
-  std::pair<FileSMSChunks,int32_t> getFileById(uint32_t id);
-  bool add_new_chunk(uint32_t file_id, uint32_t file_size, uint32_t chunk_id, Ipv4Address sender);
   void SetFiles (std::vector<FileSMS> filesToSet);
   void SetIPAdress (Ipv4Address address);
   uint32_t GetNumOfFullFiles();
-  void addNodeToSeenList(Ipv4Address sender);
-  FileSMSChunks getFileToRequest(Ipv4Address node_which_we_ask);
-
-  uint8_t* EncodeFilesForAdv();
-  std::vector<FileSMSChunks> DecodeFilesForAdv(uint8_t* raw_array, uint8_t num_advertised_files, Ipv4Address sender);
 
-  // uint32_t nodes_seen;
-
-  // We would have to enable C++2011
-  // enum packet_type : uint8_t {adv, req, resp};
-
-  typedef struct adv_header {
-    uint8_t packet_type;
-  } adv_header;
+  /**
+   * Returns the protocol state of this node, see sms-protocol.h
+   */
+  SmsProtocol& GetProtocol();
 
-  typedef struct request_header {
-    uint8_t packet_type;
-    uint32_t receiver_address;
-    uint32_t file_id;
-    uint32_t chunk_id;
-  } request_header;
+  /**
+   * Returns the advertisement of our full files. It is built once and kept
+   * until the set of full files changes, so callers must Copy() it before
+   * handing it to a socket.
+   */
+  Ptr<const Packet> GetAdvertisement();
 
-  typedef struct reply_header {
-    uint8_t packet_type;
-    uint32_t original_requester;
-    uint32_t file_id;
-    uint32_t file_size;
-    uint32_t chunk_id;
-  } reply_header;
+  /**
+   * Makes the protocol timers of this application draw from stream 'stream'
+   * instead of an automatically assigned one, so that its random numbers
+   * don't depend on what else the simulation creates.
+   *
+   * \returns the number of streams used (1)
+   */
+  int64_t AssignStreams (int64_t stream);
 
-  static const size_t reply_header_length = 13;
+  /**
+   * Returns the number of events this application has put into the
+   * simulator's queue for its protocol timers.
+   */
+  uint64_t GetNumOfTimerEvents () const;
+
+  // SmsProtocolHost, called by m_protocol
+  virtual double now() const;
+  virtual double random();
+  virtual double channel_busy();
+  virtual void schedule(SmsTimer timer, double delay);
+  virtual void cancel(SmsTimer timer);
+  virtual bool is_pending(SmsTimer timer) const;
+  virtual void send(const uint8_t* data, size_t length, uint32_t padding);
+  virtual void send_advertisement(const std::vector<uint8_t> &advertisement, uint32_t generation);
 
   /**
    * \param ip destination ipv4 address
@@ -142,6 +129,13 @@ public:
    */
   uint32_t GetDataSize (void) const;
 
+  /**
+   * Set the number of file data bytes per reply, must be called before
+   * SetFiles ().
+   */
+  void SetChunkSize (uint16_t chunkSize);
+  uint16_t GetChunkSize (void) const;
+
   /**
    * Set the data fill of the packet (what is sent as data to the server) to
    * the zero-terminated contents of the fill string string.
@@ -190,18 +184,15 @@ protected:
   virtual void DoDispose (void);
 
 private:
-  Ipv4Address address;
-
   virtual void StartApplication (void);
   virtual void StopApplication (void);
 
-  void ScheduleTransmit (Time dt);
-  void request_packet(Ipv4Address sender, FileSMSChunks file_to_request);
-  void reply(reply_header* request, uint16_t chunk_size);
-  void Send (void);
-
+  void HandleTimer (SmsTimer timer);
+  void ArmTimer (SmsTimer timer, double deadline);
+  void CancelTimerEvents ();
+  Ptr<const Packet> AdvertisementPacket (const std::vector<uint8_t> &advertisement, uint32_t generation);
   void HandleRead (Ptr<Socket> socket);
-  void HandleRequest (Ptr<Socket> socket);
+  void PhyStateChanged (Time start, Time duration, WifiPhy::State state);
 
   uint32_t m_count;
   Time m_interval;
@@ -215,16 +206,43 @@ private:
   Ptr<Socket> m_socket_send;
   Address m_peerAddress;
   uint16_t m_peerPort;
-  EventId m_sendEvent;
-  EventId m_requestEvent;
-  EventId m_replyEvent;
+  /// The protocol timers, indexed by SmsTimer
+  /// The protocol moves its deadlines on nearly every packet, the events
+  /// only follow when a deadline comes earlier, see sms-lazy-timer.h
+  LazyTimer m_timers[SMS_NUM_OF_TIMERS];
+  EventId m_timerEvents[SMS_NUM_OF_TIMERS];
+  uint64_t m_numOfTimerEvents;
   /// Callbacks for tracing the packet Tx events
   TracedCallback<Ptr<const Packet> > m_txTrace;
-
-  uint32_t maximum_full_files_seen;
-
-  // std::vector<FileSMSChunks> seen_files;
-  std::vector<Ipv4Address> seen_nodes;
+  /// Progress counters, updated as files are learnt and chunks land
+  TracedValue<uint32_t> m_fullFiles;
+  TracedValue<uint32_t> m_partialFiles;
+  TracedValue<uint32_t> m_receivedChunks;
+
+  void UpdateFileCounters ();
+
+  SmsProtocol m_protocol;
+  /// Cached advertisement packet and the generation it was built from
+  Ptr<Packet> m_advertisement;
+  uint32_t m_advertisementGeneration;
+  /// Scratch space for received packets, reused to keep them off the stack
+  std::vector<uint8_t> m_rxBuffer;
+  Ptr<UniformRandomVariable> m_random;
+  /// Fed by the PHY state trace of our wifi devices
+  ChannelLoad m_channelLoad;
+  std::string m_phyStatePath;
+
+  /// Copied into the protocol configuration when the application starts
+  uint32_t m_advBloomThreshold;
+  Time m_replyInterval;
+  uint32_t m_maxReplyQueue;
+  uint16_t m_maxChunksPerRequest;
+  Time m_neighbourExpiry;
+  Time m_overheardRequestTimeout;
+  bool m_networkCoding;
+  uint16_t m_generationSize;
+  double m_loadBackoff;
+  Time m_maxAdvertisementDeferral;
 };
 
 } // namespace ns3
@@ -154,6 +154,25 @@ SmsEchoClientHelper::Install (NodeContainer c) const
   return apps;
 }
 
+int64_t
+SmsEchoClientHelper::AssignStreams (NodeContainer c, int64_t stream)
+{
+  int64_t currentStream = stream;
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<Node> node = *i;
+      for (uint32_t j = 0; j < node->GetNApplications (); j++)
+        {
+          Ptr<SmsEchoClient> app = DynamicCast<SmsEchoClient> (node->GetApplication (j));
+          if (app)
+            {
+              currentStream += app->AssignStreams (currentStream);
+            }
+        }
+    }
+  return (currentStream - stream);
+}
+
 Ptr<SmsEchoClient>
 SmsEchoClientHelper::InstallPriv (Ptr<Node> node//, std::vector<FileSMS> fileList
 ) const
@@ -211,6 +211,18 @@ public:
    */
   ApplicationContainer Install (NodeContainer c) const;
 
+  /**
+   * Assign a fixed random variable stream number to the SmsEchoClient
+   * applications on the given nodes, so that their timers only depend on
+   * the run number and 'stream'.
+   *
+   * \param c the nodes whose applications get a stream
+   * \param stream first stream index to use
+   *
+   * \returns the number of stream indices assigned
+   */
+  int64_t AssignStreams (NodeContainer c, int64_t stream);
+
 private:
   Ptr<SmsEchoClient> InstallPriv (Ptr<Node> node) const;
   ObjectFactory m_factory;
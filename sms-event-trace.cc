@@ -0,0 +1,69 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-event-trace.h"
+#include <cstring>
+
+FILE* EventTraceBuffer::s_file = 0;
+
+const char* event_trace_type_name(uint8_t type) {
+  static const char* names[TRACE_NUM_OF_TYPES] = {
+    "adv_tx", "adv_rx", "request_tx", "request_rx",
+    "reply_tx", "reply_rx", "chunk_gained", "file_completed"
+  };
+  return type < TRACE_NUM_OF_TYPES ? names[type] : "unknown";
+}
+
+EventTraceBuffer::EventTraceBuffer() : m_count(0), m_node(0) {
+}
+
+EventTraceBuffer::~EventTraceBuffer() {
+  flush();
+}
+
+void EventTraceBuffer::set_node(uint32_t node) {
+  m_node = node;
+}
+
+void EventTraceBuffer::record(uint64_t time_ns, uint8_t type, uint32_t peer, uint32_t file_id, uint32_t chunk_id, uint16_t count) {
+  if (!is_enabled())
+    return;
+  // Only pay for the buffer once tracing is actually on
+  if (m_records.empty())
+    m_records.resize(EVENT_TRACE_BUFFER_SIZE);
+  EventTraceRecord &r = m_records[m_count++];
+  r.time_ns = time_ns;
+  r.node = m_node;
+  r.peer = peer;
+  r.file_id = file_id;
+  r.chunk_id = chunk_id;
+  r.count = count;
+  r.type = type;
+  r.reserved = 0;
+  if (m_count == EVENT_TRACE_BUFFER_SIZE)
+    flush();
+}
+
+void EventTraceBuffer::flush() {
+  if (m_count > 0 && s_file != 0)
+    fwrite(&m_records[0], sizeof(EventTraceRecord), m_count, s_file);
+  m_count = 0;
+}
+
+bool EventTraceBuffer::open(const char* path) {
+  close();
+  s_file = fopen(path, "wb");
+  if (s_file == 0)
+    return false;
+  EventTraceFileHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, EVENT_TRACE_MAGIC, sizeof(header.magic));
+  header.record_size = sizeof(EventTraceRecord);
+  fwrite(&header, sizeof(header), 1, s_file);
+  return true;
+}
+
+void EventTraceBuffer::close() {
+  if (s_file != 0) {
+    fclose(s_file);
+    s_file = 0;
+  }
+}
@@ -0,0 +1,87 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_EVENT_TRACE_H
+#define SMS_EVENT_TRACE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <vector>
+
+/*
+ * Binary protocol event trace.
+ *
+ * Every node records fixed-size events into its own buffer, which is
+ * appended to the trace file whenever it fills up and when the node stops.
+ * The file starts with an EventTraceFileHeader followed by records in host
+ * byte order; tools/sms-trace-decode turns it into CSV.
+ *
+ * Tracing is off unless EventTraceBuffer::open() was called. Building with
+ * -DSMS_NO_EVENT_TRACE removes the recording calls altogether.
+ */
+
+#define EVENT_TRACE_MAGIC "SMSTRC1"
+#define EVENT_TRACE_BUFFER_SIZE 512
+
+enum EventTraceType {
+  TRACE_ADV_TX = 0,      // file_id: number of advertised files
+  TRACE_ADV_RX,          // file_id: number of advertised files
+  TRACE_REQUEST_TX,      // chunk_id: first chunk, count: chunks asked for
+  TRACE_REQUEST_RX,
+  TRACE_REPLY_TX,
+  TRACE_REPLY_RX,
+  TRACE_CHUNK_GAINED,
+  TRACE_FILE_COMPLETED,
+  TRACE_NUM_OF_TYPES
+};
+
+struct EventTraceFileHeader {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+struct EventTraceRecord {
+  uint64_t time_ns;
+  uint32_t node;
+  uint32_t peer;       // IPv4 address of the other node, 0 if none
+  uint32_t file_id;
+  uint32_t chunk_id;
+  uint16_t count;
+  uint8_t type;
+  uint8_t reserved;
+};
+
+const char* event_trace_type_name(uint8_t type);
+
+/**
+ * \brief Per-node event buffer feeding the process-wide trace file.
+ */
+class EventTraceBuffer {
+public:
+  EventTraceBuffer();
+  ~EventTraceBuffer();
+
+  void set_node(uint32_t node);
+
+  static bool is_enabled();
+  void record(uint64_t time_ns, uint8_t type, uint32_t peer, uint32_t file_id, uint32_t chunk_id, uint16_t count);
+  void flush();
+
+  /**
+   * Opens the trace file, which enables tracing for all nodes.
+   */
+  static bool open(const char* path);
+  static void close();
+
+private:
+  std::vector<EventTraceRecord> m_records;
+  uint32_t m_count;
+  uint32_t m_node;
+
+  static FILE* s_file;
+};
+
+inline bool EventTraceBuffer::is_enabled() {
+  return s_file != 0;
+}
+
+#endif // SMS_EVENT_TRACE_H
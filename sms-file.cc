@@ -0,0 +1,25 @@
+#include "sms-file.h"
+
+FileSMS::FileSMS(unsigned int id, size_t size)
+  : mId(id)
+    , mFileSize(size)
+{
+}
+
+FileSMS::~FileSMS() {}
+
+unsigned int FileSMS::getFileId() const {
+  return mId;
+}
+
+size_t FileSMS::getFileSize() const {
+  return mFileSize;
+}
+
+bool FileSMS::operator==(const FileSMS &other) const {
+  return mId == other.mId;
+}
+
+bool FileSMS::operator!=(const FileSMS &other) const {
+  return !(*this == other);
+}
@@ -0,0 +1,23 @@
+#ifndef SMS_FILE_H
+#define SMS_FILE_H
+
+#include <cstddef>
+
+using std::size_t;
+
+class FileSMS
+{
+public:
+    FileSMS(unsigned int id, size_t size);
+    /*virtual*/ ~FileSMS();
+    unsigned int getFileId() const;
+    size_t getFileSize() const;
+    bool operator==(const FileSMS &other) const;
+    bool operator!=(const FileSMS &other) const;
+
+private:
+    unsigned int mId;
+    size_t mFileSize;
+};
+
+#endif // SMS_FILE_H
@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-gf256.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#define GF256_POLYNOMIAL 0x11D
+
+namespace {
+
+struct Gf256Tables {
+  Gf256Tables();
+
+  uint8_t exp[512];
+  uint8_t log[256];
+  uint8_t mul[256][256];
+  // c * i and c * (i << 4) for i < 16, the pshufb tables of c
+  uint8_t low[256][16];
+  uint8_t high[256][16];
+};
+
+Gf256Tables::Gf256Tables() {
+  uint32_t x = 1;
+  for (uint32_t i = 0; i < 255; i++) {
+    exp[i] = (uint8_t) x;
+    log[x] = (uint8_t) i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= GF256_POLYNOMIAL;
+  }
+  // Saves reducing the sum of two logs modulo 255
+  for (uint32_t i = 255; i < 512; i++)
+    exp[i] = exp[i - 255];
+  log[0] = 0;
+  for (uint32_t a = 0; a < 256; a++) {
+    for (uint32_t b = 0; b < 256; b++)
+      mul[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+    for (uint32_t i = 0; i < 16; i++) {
+      low[a][i] = mul[a][i];
+      high[a][i] = mul[a][i << 4];
+    }
+  }
+}
+
+// Only used through the functions below, none of them runs before main()
+const Gf256Tables tables;
+
+}
+
+uint8_t gf256_mul(uint8_t a, uint8_t b) {
+  return tables.mul[a][b];
+}
+
+uint8_t gf256_inv(uint8_t a) {
+  return tables.exp[255 - tables.log[a]];
+}
+
+void gf256_mul_add_scalar(uint8_t* dst, const uint8_t* src, uint8_t c, size_t length) {
+  const uint8_t* row = tables.mul[c];
+  for (size_t i = 0; i < length; i++)
+    dst[i] ^= row[src[i]];
+}
+
+void gf256_scale_scalar(uint8_t* dst, uint8_t c, size_t length) {
+  const uint8_t* row = tables.mul[c];
+  for (size_t i = 0; i < length; i++)
+    dst[i] = row[dst[i]];
+}
+
+void gf256_mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t length) {
+  if (c == 0)
+    return;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tables.low[c]));
+  const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tables.high[c]));
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+  for (; i + 32 <= length; i += 32) {
+    __m256i s = _mm256_loadu_si256((const __m256i*) (src + i));
+    __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(s, mask)),
+                                       _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+    __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_xor_si256(d, product));
+  }
+#elif defined(__SSSE3__)
+  const __m128i low = _mm_loadu_si128((const __m128i*) tables.low[c]);
+  const __m128i high = _mm_loadu_si128((const __m128i*) tables.high[c]);
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  for (; i + 16 <= length; i += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i*) (src + i));
+    __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(s, mask)),
+                                    _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+    __m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+    _mm_storeu_si128((__m128i*) (dst + i), _mm_xor_si128(d, product));
+  }
+#endif
+  gf256_mul_add_scalar(dst + i, src + i, c, length - i);
+}
+
+void gf256_scale(uint8_t* dst, uint8_t c, size_t length) {
+  if (c == 1)
+    return;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tables.low[c]));
+  const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tables.high[c]));
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+  for (; i + 32 <= length; i += 32) {
+    __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+    __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(d, mask)),
+                                       _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(d, 4), mask)));
+    _mm256_storeu_si256((__m256i*) (dst + i), product);
+  }
+#elif defined(__SSSE3__)
+  const __m128i low = _mm_loadu_si128((const __m128i*) tables.low[c]);
+  const __m128i high = _mm_loadu_si128((const __m128i*) tables.high[c]);
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  for (; i + 16 <= length; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+    __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(d, mask)),
+                                    _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(d, 4), mask)));
+    _mm_storeu_si128((__m128i*) (dst + i), product);
+  }
+#endif
+  gf256_scale_scalar(dst + i, c, length - i);
+}
+
+const char* gf256_kernel_name() {
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSSE3__)
+  return "ssse3";
+#else
+  return "scalar";
+#endif
+}
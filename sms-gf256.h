@@ -0,0 +1,39 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_GF256_H
+#define SMS_GF256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Arithmetic in GF(2^8) with the polynomial x^8+x^4+x^3+x^2+1 (0x11D), the
+ * field the network coded replies are computed in, see sms-rlnc.h.
+ *
+ * The region kernels multiply 16 or 32 bytes at once with the split nibble
+ * table lookup (pshufb) when the compiler targets SSSE3 or AVX2, e.g. with
+ * -march=native, and fall back to a 64 kB multiplication table otherwise.
+ */
+
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+
+// a must not be 0
+uint8_t gf256_inv(uint8_t a);
+
+/**
+ * dst[i] ^= c * src[i] for i < length
+ */
+void gf256_mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t length);
+
+/**
+ * dst[i] = c * dst[i] for i < length
+ */
+void gf256_scale(uint8_t* dst, uint8_t c, size_t length);
+
+// The table versions of the kernels, whatever the compiler targets
+void gf256_mul_add_scalar(uint8_t* dst, const uint8_t* src, uint8_t c, size_t length);
+void gf256_scale_scalar(uint8_t* dst, uint8_t c, size_t length);
+
+// "avx2", "ssse3" or "scalar"
+const char* gf256_kernel_name();
+
+#endif // SMS_GF256_H
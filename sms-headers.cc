@@ -0,0 +1,467 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-headers.h"
+#include "sms-adv-codec.h"
+#include "sms-log.h"
+#include <cstring>
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (SmsPacketTypeHeader);
+NS_OBJECT_ENSURE_REGISTERED (SmsAdvHeader);
+NS_OBJECT_ENSURE_REGISTERED (SmsRequestHeader);
+NS_OBJECT_ENSURE_REGISTERED (SmsRangeRequestHeader);
+NS_OBJECT_ENSURE_REGISTERED (SmsReplyHeader);
+NS_OBJECT_ENSURE_REGISTERED (SmsCodedRequestHeader);
+NS_OBJECT_ENSURE_REGISTERED (SmsCodedReplyHeader);
+
+SmsPacketTypeHeader::SmsPacketTypeHeader () : m_packetType (0) {
+}
+
+TypeId
+SmsPacketTypeHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsPacketTypeHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsPacketTypeHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsPacketTypeHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsPacketTypeHeader::Print (std::ostream &os) const {
+  os << "type=" << (uint32_t) m_packetType;
+}
+
+uint32_t SmsPacketTypeHeader::GetSerializedSize (void) const {
+  return 1;
+}
+
+void SmsPacketTypeHeader::Serialize (Buffer::Iterator start) const {
+  start.WriteU8 (m_packetType);
+}
+
+uint32_t SmsPacketTypeHeader::Deserialize (Buffer::Iterator start) {
+  m_packetType = start.ReadU8 ();
+  return 1;
+}
+
+uint8_t SmsPacketTypeHeader::GetPacketType (void) const {
+  return m_packetType;
+}
+
+SmsAdvHeader::SmsAdvHeader () : m_version (ADV_VERSION), m_mode (ADV_MODE_LIST), m_chunkSize (DEFAULT_CHUNK_SIZE) {
+}
+
+TypeId
+SmsAdvHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsAdvHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsAdvHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsAdvHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsAdvHeader::Print (std::ostream &os) const {
+  os << "adv version=" << (uint32_t) m_version << " mode=" << (m_mode == ADV_MODE_BLOOM ? "bloom" : "list")
+     << " chunk_size=" << m_chunkSize;
+}
+
+uint32_t SmsAdvHeader::GetSerializedSize (void) const {
+  // The chunk size is a varint
+  uint32_t size = ADV_HEADER_LENGTH + 1;
+  for (uint32_t value = m_chunkSize; value >= 0x80; value >>= 7)
+    size++;
+  return size;
+}
+
+void SmsAdvHeader::Serialize (Buffer::Iterator start) const {
+  start.WriteU8 (0);
+  start.WriteU8 ((m_version << 4) | m_mode);
+  uint32_t value = m_chunkSize;
+  while (value >= 0x80) {
+    start.WriteU8 ((uint8_t) (value | 0x80));
+    value >>= 7;
+  }
+  start.WriteU8 ((uint8_t) value);
+}
+
+uint32_t SmsAdvHeader::Deserialize (Buffer::Iterator start) {
+  start.ReadU8 ();
+  uint8_t version_and_mode = start.ReadU8 ();
+  m_version = version_and_mode >> 4;
+  m_mode = version_and_mode & 0x0F;
+  uint32_t size = ADV_HEADER_LENGTH;
+  m_chunkSize = 0;
+  for (uint32_t shift = 0; shift < 32; shift += 7) {
+    uint8_t byte = start.ReadU8 ();
+    size++;
+    m_chunkSize |= (uint32_t) (byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  return size;
+}
+
+void SmsAdvHeader::SetMode (uint8_t mode) {
+  m_mode = mode;
+}
+
+uint8_t SmsAdvHeader::GetMode (void) const {
+  return m_mode;
+}
+
+uint8_t SmsAdvHeader::GetVersion (void) const {
+  return m_version;
+}
+
+void SmsAdvHeader::SetChunkSize (uint32_t chunkSize) {
+  m_chunkSize = chunkSize;
+}
+
+uint32_t SmsAdvHeader::GetChunkSize (void) const {
+  return m_chunkSize;
+}
+
+SmsRequestHeader::SmsRequestHeader () {
+  memset (&m_header, 0, sizeof (m_header));
+  m_header.packet_type = 1;
+}
+
+TypeId
+SmsRequestHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsRequestHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsRequestHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsRequestHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsRequestHeader::Print (std::ostream &os) const {
+  os << "request to=" << SmsAddress (m_header.receiver_address) << " file=" << m_header.file_id
+     << " chunk=" << m_header.chunk_id;
+}
+
+uint32_t SmsRequestHeader::GetSerializedSize (void) const {
+  return SmsProtocol::request_header::serialized_size;
+}
+
+void SmsRequestHeader::Serialize (Buffer::Iterator start) const {
+  uint8_t data[SmsProtocol::request_header::serialized_size];
+  m_header.serialize (data);
+  start.Write (data, sizeof (data));
+}
+
+uint32_t SmsRequestHeader::Deserialize (Buffer::Iterator start) {
+  uint8_t data[SmsProtocol::request_header::serialized_size];
+  start.Read (data, sizeof (data));
+  m_header.deserialize (data, sizeof (data));
+  return sizeof (data);
+}
+
+void SmsRequestHeader::Set (const SmsProtocol::request_header &header) {
+  m_header = header;
+}
+
+const SmsProtocol::request_header& SmsRequestHeader::Get (void) const {
+  return m_header;
+}
+
+SmsRangeRequestHeader::SmsRangeRequestHeader () {
+  memset (&m_header, 0, sizeof (m_header));
+  m_header.packet_type = 3;
+}
+
+TypeId
+SmsRangeRequestHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsRangeRequestHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsRangeRequestHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsRangeRequestHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsRangeRequestHeader::Print (std::ostream &os) const {
+  os << "range request to=" << SmsAddress (m_header.receiver_address) << " file=" << m_header.file_id
+     << " chunks=" << m_header.first_chunk << "+" << m_header.num_of_chunks;
+}
+
+uint32_t SmsRangeRequestHeader::GetSerializedSize (void) const {
+  return SmsProtocol::range_request_header::serialized_size;
+}
+
+void SmsRangeRequestHeader::Serialize (Buffer::Iterator start) const {
+  uint8_t data[SmsProtocol::range_request_header::serialized_size];
+  m_header.serialize (data);
+  start.Write (data, sizeof (data));
+}
+
+uint32_t SmsRangeRequestHeader::Deserialize (Buffer::Iterator start) {
+  uint8_t data[SmsProtocol::range_request_header::serialized_size];
+  start.Read (data, sizeof (data));
+  m_header.deserialize (data, sizeof (data));
+  return sizeof (data);
+}
+
+void SmsRangeRequestHeader::Set (const SmsProtocol::range_request_header &header) {
+  m_header = header;
+}
+
+const SmsProtocol::range_request_header& SmsRangeRequestHeader::Get (void) const {
+  return m_header;
+}
+
+SmsReplyHeader::SmsReplyHeader () {
+  memset (&m_header, 0, sizeof (m_header));
+  m_header.packet_type = 2;
+}
+
+TypeId
+SmsReplyHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsReplyHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsReplyHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsReplyHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsReplyHeader::Print (std::ostream &os) const {
+  os << "reply for=" << SmsAddress (m_header.original_requester) << " file=" << m_header.file_id
+     << " size=" << m_header.file_size << " chunk=" << m_header.chunk_id << "/" << m_header.chunk_size;
+}
+
+uint32_t SmsReplyHeader::GetSerializedSize (void) const {
+  return SmsProtocol::reply_header::serialized_size;
+}
+
+void SmsReplyHeader::Serialize (Buffer::Iterator start) const {
+  uint8_t data[SmsProtocol::reply_header::serialized_size];
+  m_header.serialize (data);
+  start.Write (data, sizeof (data));
+}
+
+uint32_t SmsReplyHeader::Deserialize (Buffer::Iterator start) {
+  uint8_t data[SmsProtocol::reply_header::serialized_size];
+  start.Read (data, sizeof (data));
+  m_header.deserialize (data, sizeof (data));
+  return sizeof (data);
+}
+
+void SmsReplyHeader::Set (const SmsProtocol::reply_header &header) {
+  m_header = header;
+}
+
+const SmsProtocol::reply_header& SmsReplyHeader::Get (void) const {
+  return m_header;
+}
+
+SmsCodedRequestHeader::SmsCodedRequestHeader () {
+  memset (&m_header, 0, sizeof (m_header));
+  m_header.packet_type = 4;
+}
+
+TypeId
+SmsCodedRequestHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsCodedRequestHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsCodedRequestHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsCodedRequestHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsCodedRequestHeader::Print (std::ostream &os) const {
+  os << "coded request to=" << SmsAddress (m_header.receiver_address) << " file=" << m_header.file_id
+     << " generation=" << m_header.generation << "/" << m_header.generation_size
+     << " packets=" << m_header.num_of_packets;
+}
+
+uint32_t SmsCodedRequestHeader::GetSerializedSize (void) const {
+  return SmsProtocol::coded_request_header::serialized_size;
+}
+
+void SmsCodedRequestHeader::Serialize (Buffer::Iterator start) const {
+  uint8_t data[SmsProtocol::coded_request_header::serialized_size];
+  m_header.serialize (data);
+  start.Write (data, sizeof (data));
+}
+
+uint32_t SmsCodedRequestHeader::Deserialize (Buffer::Iterator start) {
+  uint8_t data[SmsProtocol::coded_request_header::serialized_size];
+  start.Read (data, sizeof (data));
+  m_header.deserialize (data, sizeof (data));
+  return sizeof (data);
+}
+
+void SmsCodedRequestHeader::Set (const SmsProtocol::coded_request_header &header) {
+  m_header = header;
+}
+
+const SmsProtocol::coded_request_header& SmsCodedRequestHeader::Get (void) const {
+  return m_header;
+}
+
+SmsCodedReplyHeader::SmsCodedReplyHeader () {
+  memset (&m_header, 0, sizeof (m_header));
+  m_header.packet_type = 5;
+}
+
+TypeId
+SmsCodedReplyHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsCodedReplyHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SmsCodedReplyHeader> ()
+  ;
+  return tid;
+}
+
+TypeId SmsCodedReplyHeader::GetInstanceTypeId (void) const {
+  return GetTypeId ();
+}
+
+void SmsCodedReplyHeader::Print (std::ostream &os) const {
+  os << "coded reply for=" << SmsAddress (m_header.original_requester) << " file=" << m_header.file_id
+     << " size=" << m_header.file_size << " generation=" << m_header.generation << "/" << m_header.generation_size
+     << " seed=" << m_header.seed << " chunk_size=" << m_header.chunk_size << " remaining=" << m_header.remaining;
+}
+
+uint32_t SmsCodedReplyHeader::GetSerializedSize (void) const {
+  return SmsProtocol::coded_reply_header::serialized_size;
+}
+
+void SmsCodedReplyHeader::Serialize (Buffer::Iterator start) const {
+  uint8_t data[SmsProtocol::coded_reply_header::serialized_size];
+  m_header.serialize (data);
+  start.Write (data, sizeof (data));
+}
+
+uint32_t SmsCodedReplyHeader::Deserialize (Buffer::Iterator start) {
+  uint8_t data[SmsProtocol::coded_reply_header::serialized_size];
+  start.Read (data, sizeof (data));
+  m_header.deserialize (data, sizeof (data));
+  return sizeof (data);
+}
+
+void SmsCodedReplyHeader::Set (const SmsProtocol::coded_reply_header &header) {
+  m_header = header;
+}
+
+const SmsProtocol::coded_reply_header& SmsCodedReplyHeader::Get (void) const {
+  return m_header;
+}
+
+// Packets of the header structs of SmsProtocol
+template <class H, class T>
+static Ptr<Packet> CreateWithHeader (const uint8_t* data, size_t length) {
+  T fields;
+  if (!fields.deserialize (data, length))
+    return Create<Packet> (data, length);
+  H header;
+  header.Set (fields);
+  uint32_t size = header.GetSerializedSize ();
+  Ptr<Packet> packet = Create<Packet> (data + size, length - size);
+  packet->AddHeader (header);
+  return packet;
+}
+
+Ptr<Packet> SmsCreatePacket (const uint8_t* data, size_t length) {
+  if (length == 0)
+    return Create<Packet> ();
+  switch (data[0]) {
+  case 0: {
+    AdvDecoder decoder (data, length);
+    if (!decoder.is_valid ())
+      break;
+    SmsAdvHeader header;
+    header.SetMode (decoder.get_mode ());
+    header.SetChunkSize (decoder.get_chunk_size ());
+    uint32_t size = header.GetSerializedSize ();
+    Ptr<Packet> packet = Create<Packet> (data + size, length - size);
+    packet->AddHeader (header);
+    return packet;
+  }
+  case 1:
+    return CreateWithHeader<SmsRequestHeader, SmsProtocol::request_header> (data, length);
+  case 2:
+    return CreateWithHeader<SmsReplyHeader, SmsProtocol::reply_header> (data, length);
+  case 3:
+    return CreateWithHeader<SmsRangeRequestHeader, SmsProtocol::range_request_header> (data, length);
+  case 4:
+    return CreateWithHeader<SmsCodedRequestHeader, SmsProtocol::coded_request_header> (data, length);
+  case 5:
+    return CreateWithHeader<SmsCodedReplyHeader, SmsProtocol::coded_reply_header> (data, length);
+  }
+  return Create<Packet> (data, length);
+}
+
+// PeekHeader() must not read past the end of the packet
+template <class H>
+static void PrintWithHeader (Ptr<const Packet> packet, uint32_t size, std::ostream &os) {
+  if (packet->GetSize () < size) {
+    os << "truncated packet of " << packet->GetSize () << " bytes";
+    return;
+  }
+  H header;
+  packet->PeekHeader (header);
+  header.Print (os);
+}
+
+void SmsPrintHeader (Ptr<const Packet> packet, uint8_t packetType, std::ostream &os) {
+  switch (packetType) {
+  case 0: {
+    // The chunk size varint has to end within the packet
+    uint8_t start[ADV_HEADER_LENGTH + 5];
+    uint32_t length = packet->CopyData (start, sizeof (start));
+    uint32_t end = ADV_HEADER_LENGTH;
+    while (end < length && (start[end] & 0x80))
+      end++;
+    PrintWithHeader<SmsAdvHeader> (packet, end < length ? end + 1 : packet->GetSize () + 1, os);
+    return;
+  }
+  case 1:
+    PrintWithHeader<SmsRequestHeader> (packet, SmsProtocol::request_header::serialized_size, os);
+    return;
+  case 2:
+    PrintWithHeader<SmsReplyHeader> (packet, SmsProtocol::reply_header::serialized_size, os);
+    return;
+  case 3:
+    PrintWithHeader<SmsRangeRequestHeader> (packet, SmsProtocol::range_request_header::serialized_size, os);
+    return;
+  case 4:
+    PrintWithHeader<SmsCodedRequestHeader> (packet, SmsProtocol::coded_request_header::serialized_size, os);
+    return;
+  case 5:
+    PrintWithHeader<SmsCodedReplyHeader> (packet, SmsProtocol::coded_reply_header::serialized_size, os);
+    return;
+  }
+  os << "type=" << (uint32_t) packetType;
+}
+
+} // namespace ns3
@@ -0,0 +1,184 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_HEADERS_H
+#define SMS_HEADERS_H
+
+#include "ns3/header.h"
+#include "ns3/packet.h"
+#include "sms-protocol.h"
+#include <ostream>
+
+namespace ns3 {
+
+/*
+ * The packet headers of the protocol as ns-3 headers, for code that builds
+ * or inspects packets with AddHeader(), RemoveHeader() and PeekHeader().
+ * SmsEchoClient sends its packets with them, see SmsCreatePacket().
+ * They write exactly the bytes SmsProtocol puts on the wire, see the header
+ * structs in sms-protocol.h and sms-adv-codec.h. The first byte of every
+ * packet is its type, peek it with SmsPacketTypeHeader.
+ */
+
+class SmsPacketTypeHeader : public Header
+{
+public:
+  SmsPacketTypeHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  uint8_t GetPacketType (void) const;
+
+private:
+  uint8_t m_packetType;
+};
+
+/**
+ * \brief Type, mode and chunk size of an advertisement, the encoded files
+ * follow.
+ */
+class SmsAdvHeader : public Header
+{
+public:
+  SmsAdvHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void SetMode (uint8_t mode);
+  uint8_t GetMode (void) const;
+  uint8_t GetVersion (void) const;
+  void SetChunkSize (uint32_t chunkSize);
+  uint32_t GetChunkSize (void) const;
+
+private:
+  uint8_t m_version;
+  uint8_t m_mode;
+  uint32_t m_chunkSize;
+};
+
+class SmsRequestHeader : public Header
+{
+public:
+  SmsRequestHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void Set (const SmsProtocol::request_header &header);
+  const SmsProtocol::request_header& Get (void) const;
+
+private:
+  SmsProtocol::request_header m_header;
+};
+
+class SmsRangeRequestHeader : public Header
+{
+public:
+  SmsRangeRequestHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void Set (const SmsProtocol::range_request_header &header);
+  const SmsProtocol::range_request_header& Get (void) const;
+
+private:
+  SmsProtocol::range_request_header m_header;
+};
+
+/**
+ * \brief A reply, the chunk follows.
+ */
+class SmsReplyHeader : public Header
+{
+public:
+  SmsReplyHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void Set (const SmsProtocol::reply_header &header);
+  const SmsProtocol::reply_header& Get (void) const;
+
+private:
+  SmsProtocol::reply_header m_header;
+};
+
+class SmsCodedRequestHeader : public Header
+{
+public:
+  SmsCodedRequestHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void Set (const SmsProtocol::coded_request_header &header);
+  const SmsProtocol::coded_request_header& Get (void) const;
+
+private:
+  SmsProtocol::coded_request_header m_header;
+};
+
+/**
+ * \brief A coded reply, the combination of the chunks follows.
+ */
+class SmsCodedReplyHeader : public Header
+{
+public:
+  SmsCodedReplyHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void Set (const SmsProtocol::coded_reply_header &header);
+  const SmsProtocol::coded_reply_header& Get (void) const;
+
+private:
+  SmsProtocol::coded_reply_header m_header;
+};
+
+/**
+ * Builds the packet of 'data', bytes SmsProtocol puts on the wire: the
+ * header of its packet type is added with AddHeader() in front of the rest.
+ * The packet holds the same bytes, data that doesn't parse goes in as it
+ * is.
+ */
+Ptr<Packet> SmsCreatePacket (const uint8_t* data, size_t length);
+
+/**
+ * Prints the header of 'packet', a packet of type 'packetType' (see
+ * SmsPacketTypeHeader), peeked with the header class of that type.
+ */
+void SmsPrintHeader (Ptr<const Packet> packet, uint8_t packetType, std::ostream &os);
+
+} // namespace ns3
+
+#endif // SMS_HEADERS_H
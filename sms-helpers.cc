@@ -1,34 +1,31 @@
 #include "sms-helpers.h"
-
-FileSMS::FileSMS(unsigned int id, size_t size)
-  : mId(id)
-    , mFileSize(size)
+#include <sstream>
+
+// These are just examples, the values may be different
+SmsScenario::SmsScenario()
+  : numOfNodes(25)
+    , duration(900.0)
+    , totalFileCount(100)
+    , maxFileCountPerNode(10)
+    , zipfExponent(1.1)
+    , minX(-50)
+    , maxX(50)
+    , minY(-50)
+    , maxY(50)
+    , randomPlacement(false)
 {
 }
 
-FileSMS::~FileSMS() {}
-
-unsigned int FileSMS::getFileId() const {
-  return mId;
-}
-
-size_t FileSMS::getFileSize() const {
-  return mFileSize;
-}
-
-bool FileSMS::operator==(const FileSMS &other) const {
-  return mId == other.mId;
-}
-
-bool FileSMS::operator!=(const FileSMS &other) const {
-  return !(*this == other);
+SmsScenario &getScenario() {
+    static SmsScenario scenario;
+    return scenario;
 }
 
 /**
  * Returns the total number of mobile nodes running in the simulation
  */
 unsigned int getNumberOfMobileNodes() {
-    return 25; // This is just an example, the number may be different
+    return getScenario().numOfNodes;
 }
 
 /**
@@ -36,7 +33,7 @@ unsigned int getNumberOfMobileNodes() {
  * after which the simulation must be stopped
  */
 double getSimulationDuration() {
-    return 900.0; // This is just an example, the number may be different
+    return getScenario().duration;
 }
 
 /**
@@ -45,16 +42,26 @@ double getSimulationDuration() {
 void installMobility(NodeContainer &c) {
     MobilityHelper mobility;
 
-    // These are just examples, the parameters may be different
-    mobility.SetPositionAllocator("ns3::GridPositionAllocator",
-                                  "MinX", DoubleValue(0.0),
-                                  "MinY", DoubleValue(0.0),
-                                  "DeltaX", DoubleValue(5.0),
-                                  "DeltaY", DoubleValue(10.0),
-                                  "GridWidth", UintegerValue(5),
-                                  "LayoutType", StringValue("RowFirst"));
+    const SmsScenario &scenario = getScenario();
+    if (scenario.randomPlacement) {
+        std::stringstream x, y;
+        x << "ns3::UniformRandomVariable[Min=" << scenario.minX << "|Max=" << scenario.maxX << "]";
+        y << "ns3::UniformRandomVariable[Min=" << scenario.minY << "|Max=" << scenario.maxY << "]";
+        mobility.SetPositionAllocator("ns3::RandomRectanglePositionAllocator",
+                                      "X", StringValue(x.str()),
+                                      "Y", StringValue(y.str()));
+    } else {
+        // These are just examples, the parameters may be different
+        mobility.SetPositionAllocator("ns3::GridPositionAllocator",
+                                      "MinX", DoubleValue(0.0),
+                                      "MinY", DoubleValue(0.0),
+                                      "DeltaX", DoubleValue(5.0),
+                                      "DeltaY", DoubleValue(10.0),
+                                      "GridWidth", UintegerValue(5),
+                                      "LayoutType", StringValue("RowFirst"));
+    }
     mobility.SetMobilityModel("ns3::RandomWalk2dMobilityModel",
-                              "Bounds", RectangleValue(Rectangle(-50, 50, -50, 50)));
+                              "Bounds", RectangleValue(Rectangle(scenario.minX, scenario.maxX, scenario.minY, scenario.maxY)));
 
     mobility.Install(c);
 }
@@ -98,7 +105,8 @@ void installWifi(NodeContainer &c, NetDeviceContainer &devices) {
                                  "ControlMode", StringValue(phyMode));
 
     devices = wifi.Install(wifiPhy, wifiMac, c);
-    wifiPhy.EnablePcap ("sms16", devices);
+    if (!getScenario().pcapPrefix.empty())
+        wifiPhy.EnablePcap (getScenario().pcapPrefix, devices);
 }
 
 /**
@@ -115,8 +123,8 @@ std::vector<FileSMS> getInitialFileList() {
     //   - File size (keep in mind that different files may have different sizes)
     //   - Something else
 
-    static const unsigned int totalFileCount = 100;
-    static const unsigned int maxFileCountPerNode = 10;
+    const unsigned int totalFileCount = getScenario().totalFileCount;
+    const unsigned int maxFileCountPerNode = getScenario().maxFileCountPerNode;
     std::vector<FileSMS> files;
 
     // selecting number of files the node will store
@@ -126,7 +134,7 @@ std::vector<FileSMS> getInitialFileList() {
 
     // selecting file id and file size
     UniformVariable fileSizeRand;
-    ZipfVariable zipfRandom = ZipfVariable(totalFileCount, 1.1);
+    ZipfVariable zipfRandom = ZipfVariable(totalFileCount, getScenario().zipfExponent);
     for (unsigned int i = 0; i < numOfFiles; i++) {
         FileSMS file(zipfRandom.GetInteger(), 1000);
         std::vector<FileSMS>::const_iterator iter = std::find(files.begin(), files.end(), file);
@@ -8,29 +8,42 @@
 #include "ns3/internet-module.h"
 #include "ns3/random-variable.h"
 #include "cstdio"
+#include "sms-file.h"
 
 #include <algorithm>
 #include <vector>
 
 using namespace ns3;
-using std::size_t;
 
 
-class FileSMS
+/**
+ * Parameters of one simulation run. The getters below read them, so a driver
+ * can vary them per run instead of recompiling.
+ */
+struct SmsScenario
 {
-public:
-    FileSMS(unsigned int id, size_t size);
-    /*virtual*/ ~FileSMS();
-    unsigned int getFileId() const;
-    size_t getFileSize() const;
-    bool operator==(const FileSMS &other) const;
-    bool operator!=(const FileSMS &other) const;
+    SmsScenario();
 
-private:
-    unsigned int mId;
-    size_t mFileSize;
+    unsigned int numOfNodes;
+    double duration;
+    unsigned int totalFileCount;
+    unsigned int maxFileCountPerNode;
+    // Exponent of the Zipf popularity of the files
+    double zipfExponent;
+    // Area the nodes move in
+    double minX, maxX, minY, maxY;
+    // Place the nodes uniformly over the area instead of on a small grid
+    bool randomPlacement;
+    // Prefix for a radiotap pcap file per node, e.g. "<output dir>/sms16",
+    // empty for none
+    std::string pcapPrefix;
 };
 
+/**
+ * Returns the scenario of the current run, which may be modified before
+ * the nodes are created
+ */
+SmsScenario &getScenario();
 
 /**
  * Returns the total number of mobile nodes running in the simulation
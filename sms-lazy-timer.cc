@@ -0,0 +1,41 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-lazy-timer.h"
+
+// Hosts round times, ns-3 to nanoseconds. A deadline within this of the
+// time the event fired counts as reached.
+#define LAZY_TIMER_SLACK 1e-9
+
+LazyTimer::LazyTimer() : m_deadline(0), m_set(false), m_event_time(0), m_event_pending(false) {
+}
+
+bool LazyTimer::set(double deadline) {
+  m_deadline = deadline;
+  m_set = true;
+  if (m_event_pending && m_event_time <= deadline + LAZY_TIMER_SLACK)
+    return false;
+  m_event_time = deadline;
+  m_event_pending = true;
+  return true;
+}
+
+void LazyTimer::clear() {
+  m_set = false;
+}
+
+void LazyTimer::reset() {
+  m_set = false;
+  m_event_pending = false;
+}
+
+LazyTimer::Action LazyTimer::fire(double now) {
+  m_event_pending = false;
+  if (!m_set)
+    return LAZY_TIMER_IDLE;
+  if (m_deadline > now + LAZY_TIMER_SLACK) {
+    m_event_time = m_deadline;
+    m_event_pending = true;
+    return LAZY_TIMER_REARM;
+  }
+  m_set = false;
+  return LAZY_TIMER_EXPIRE;
+}
@@ -0,0 +1,69 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_LAZY_TIMER_H
+#define SMS_LAZY_TIMER_H
+
+/**
+ * \brief The deadline of one protocol timer, backed by at most one pending
+ * event in the host's scheduler.
+ *
+ * The protocol moves its deadlines on nearly every packet, mostly to later.
+ * Instead of cancelling and scheduling an event each time, the pending event
+ * is left alone when it comes no later than the new deadline: when it fires
+ * the host re-arms it at the deadline, or drops it if the timer was cleared
+ * meanwhile. Only a deadline that moves earlier than the pending event
+ * needs a new one.
+ */
+class LazyTimer {
+public:
+  enum Action {
+    // Cleared, nothing to do
+    LAZY_TIMER_IDLE,
+    // The deadline moved later, arm an event at get_deadline()
+    LAZY_TIMER_REARM,
+    // The deadline has come, run the timer
+    LAZY_TIMER_EXPIRE
+  };
+
+  LazyTimer();
+
+  /**
+   * Sets the deadline, replacing the previous one. Returns true if the
+   * host has to schedule an event at 'deadline', replacing its pending
+   * one if there is one.
+   */
+  bool set(double deadline);
+
+  // The pending event, if any, stays and will find nothing to do
+  void clear();
+
+  /**
+   * Clears the timer and forgets the pending event, for when the host
+   * dropped it itself.
+   */
+  void reset();
+
+  bool is_set() const;
+  double get_deadline() const;
+
+  /**
+   * The host's event fired at 'now', see Action for what to do.
+   */
+  Action fire(double now);
+
+private:
+  double m_deadline;
+  bool m_set;
+  // When the host's pending event fires, if there is one
+  double m_event_time;
+  bool m_event_pending;
+};
+
+inline bool LazyTimer::is_set() const {
+  return m_set;
+}
+
+inline double LazyTimer::get_deadline() const {
+  return m_deadline;
+}
+
+#endif // SMS_LAZY_TIMER_H
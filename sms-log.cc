@@ -0,0 +1,38 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-log.h"
+#include <algorithm>
+
+SmsLogLevel g_sms_log_level = SMS_LEVEL_NONE;
+static SmsLogSink s_sink = 0;
+static SmsLogLevel s_sink_level = SMS_LEVEL_NONE;
+static SmsLogSink s_watcher = 0;
+static SmsLogLevel s_watcher_level = SMS_LEVEL_NONE;
+
+static void update_level() {
+  g_sms_log_level = std::max(s_sink != 0 ? s_sink_level : SMS_LEVEL_NONE,
+                             s_watcher != 0 ? s_watcher_level : SMS_LEVEL_NONE);
+}
+
+void sms_log_set_sink(SmsLogSink sink, SmsLogLevel level) {
+  s_sink = sink;
+  s_sink_level = level;
+  update_level();
+}
+
+void sms_log_set_watcher(SmsLogSink watcher, SmsLogLevel level) {
+  s_watcher = watcher;
+  s_watcher_level = level;
+  update_level();
+}
+
+void sms_log_write(SmsLogLevel level, const std::string &message) {
+  if (s_sink != 0 && level <= s_sink_level)
+    s_sink(level, message);
+  if (s_watcher != 0 && level <= s_watcher_level)
+    s_watcher(level, message);
+}
+
+std::ostream& operator<<(std::ostream &os, SmsAddress a) {
+  return os << (a.address >> 24) << "." << ((a.address >> 16) & 0xFF) << "."
+            << ((a.address >> 8) & 0xFF) << "." << (a.address & 0xFF);
+}
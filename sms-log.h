@@ -0,0 +1,61 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_LOG_H
+#define SMS_LOG_H
+
+#include <stdint.h>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+/*
+ * Logging for the code that doesn't depend on ns-3. Messages go to a sink
+ * set by the driver: SmsEchoClient forwards them to its NS_LOG component,
+ * the contact simulation writes them to stderr. Nothing is formatted
+ * unless the level is enabled.
+ */
+
+enum SmsLogLevel {
+  SMS_LEVEL_NONE = 0,
+  SMS_LEVEL_WARN,
+  SMS_LEVEL_INFO
+};
+
+typedef void (*SmsLogSink)(SmsLogLevel level, const std::string &message);
+
+void sms_log_set_sink(SmsLogSink sink, SmsLogLevel level);
+/**
+ * Also hands the messages up to 'level' to 'watcher', whatever the level
+ * of the sink. The packet capture uses it to dump its ring on warnings.
+ */
+void sms_log_set_watcher(SmsLogSink watcher, SmsLogLevel level);
+void sms_log_write(SmsLogLevel level, const std::string &message);
+
+extern SmsLogLevel g_sms_log_level;
+
+inline bool sms_log_enabled(SmsLogLevel level) {
+  return level <= g_sms_log_level;
+}
+
+#define SMS_LOG(level, msg) \
+  do { \
+    if (sms_log_enabled (level)) { \
+      std::stringstream sms_log_ss; \
+      sms_log_ss << msg; \
+      sms_log_write (level, sms_log_ss.str ()); \
+    } \
+  } while (0)
+
+#define SMS_LOG_INFO(msg) SMS_LOG(SMS_LEVEL_INFO, msg)
+#define SMS_LOG_WARN(msg) SMS_LOG(SMS_LEVEL_WARN, msg)
+
+/**
+ * \brief Prints an IPv4 address kept as a host order integer in dotted form.
+ */
+struct SmsAddress {
+  explicit SmsAddress(uint32_t address) : address(address) {}
+  uint32_t address;
+};
+
+std::ostream& operator<<(std::ostream &os, SmsAddress a);
+
+#endif // SMS_LOG_H
@@ -1,15 +1,257 @@
 #include "sms-helpers.h"
 #include "sms-echo-helper.h"
+#include "sms-event-trace.h"
+#include "sms-distributed.h"
+#include "sms-metrics.h"
+#include "sms-capture.h"
+#include "sms-convergence.h"
+#include "sms-log.h"
 #include <iostream>
 #include <set>
 #include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <sys/stat.h>
 
 NS_LOG_COMPONENT_DEFINE("SMSProject");
 
+namespace ns3 {
+
+/**
+ * The default scheduler of ns-3, counting the events it hands to the
+ * simulator, cancelled ones included.
+ */
+class SmsCountingScheduler : public MapScheduler {
+public:
+  static TypeId GetTypeId (void);
+  virtual Scheduler::Event RemoveNext (void);
+
+  static uint64_t s_numOfEvents;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (SmsCountingScheduler);
+
+uint64_t SmsCountingScheduler::s_numOfEvents = 0;
+
+TypeId
+SmsCountingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SmsCountingScheduler")
+    .SetParent<MapScheduler> ()
+    .AddConstructor<SmsCountingScheduler> ()
+  ;
+  return tid;
+}
+
+Scheduler::Event
+SmsCountingScheduler::RemoveNext (void)
+{
+  s_numOfEvents++;
+  return MapScheduler::RemoveNext ();
+}
+
+}
+
+// Time of the last file completion on any node, -1 if there was none
+static double last_completion_time = -1;
+
+static void file_completed(uint32_t old_value, uint32_t new_value) {
+    if (new_value > old_value && Simulator::Now().IsStrictlyPositive())
+        last_completion_time = Simulator::Now().GetSeconds();
+}
+
+static SmsMetrics metrics;
+static double last_metrics_sample = -1;
+
+static void sample_metrics(Time interval) {
+    last_metrics_sample = Simulator::Now().GetSeconds();
+    metrics.sample(last_metrics_sample);
+    Simulator::Schedule(interval, &sample_metrics, interval);
+}
+
+static SmsConvergence convergence;
+static bool stop_on_convergence = true;
+// Time the last file needed for convergence completed, -1 until then
+static double convergence_time = -1;
+
+static void check_convergence() {
+    double now = Simulator::Now().GetSeconds();
+    SmsConvergence::State state = convergence.check(now);
+    if (state == SmsConvergence::CONVERGENCE_RUNNING) {
+        Simulator::Schedule(Seconds(CONVERGENCE_CHECK_INTERVAL), &check_convergence);
+        return;
+    }
+    if (state == SmsConvergence::CONVERGENCE_CONVERGED) {
+        convergence_time = last_completion_time >= 0 ? last_completion_time : now;
+        NS_LOG_UNCOND("Converged at " << convergence_time << " s, noticed at " << now << " s");
+        if (!stop_on_convergence)
+            return;
+    } else {
+        NS_LOG_UNCOND("No chunk gained since " << convergence.get_last_progress() << " s, stopping at " << now << " s");
+    }
+    Simulator::Stop();
+}
+
+static SmsCapture capture;
+
+static void capture_frame(uint32_t node, SmsCapture::Direction direction, Ptr<const Packet> packet) {
+    uint64_t now = Simulator::Now().GetNanoSeconds();
+    if (!capture.is_wanted(node, now))
+        return;
+    static std::vector<uint8_t> frame;
+    frame.resize(packet->GetSize());
+    uint8_t* data = frame.empty() ? 0 : &frame[0];
+    if (data != 0)
+        packet->CopyData(data, frame.size());
+    capture.add_frame(node, direction, now, data, frame.size());
+}
+
+static void capture_tx(uint32_t node, Ptr<const Packet> packet) {
+    capture_frame(node, SmsCapture::CAPTURE_OUTBOUND, packet);
+}
+
+static void capture_rx(uint32_t node, Ptr<const Packet> packet) {
+    capture_frame(node, SmsCapture::CAPTURE_INBOUND, packet);
+}
+
+// Protocol warnings, the received frame that caused one is already in the ring
+static void capture_warning(SmsLogLevel, const std::string &message) {
+    capture.on_warning(Simulator::Now().GetNanoSeconds(), message);
+}
+
+static void generate_file_lists(uint32_t num_of_nodes, std::vector< std::vector<FileSMS> > &lists) {
+    for (uint32_t i = 0; i < num_of_nodes; i++)
+        lists.push_back(getInitialFileList());
+}
+
 int main(int argc, char* argv[]) {
+    SmsPartition partition;
+    partition.enable(&argc, &argv);
+
+    SmsScenario &scenario = getScenario();
+    // Keep the 100 s the simulation has always been run with
+    scenario.duration = 100;
+    std::string eventTrace = "";
+    std::string outputDir = ".";
+    uint32_t chunkSize = DEFAULT_CHUNK_SIZE;
+    bool coding = false;
+    double metricsInterval = 1.0;
+    double loadBackoff = 0;
+    double maxAdvertisementDeferral = 0;
+    double stallWindow = 0;
+    std::string pcap = "none";
+    std::string pcapNodes = "";
+    std::string pcapTypes = "";
+    double pcapStart = 0;
+    double pcapStop = 0;
+    uint32_t pcapSnapLength = 0;
+    uint32_t pcapRing = 1000;
+    std::string pcapTrigger = SMS_CAPTURE_TRIGGERS;
+    bool pcapCompress = false;
+    CommandLine cmd;
+    cmd.AddValue("nodes", "Number of mobile nodes", scenario.numOfNodes);
+    cmd.AddValue("duration", "Simulated seconds", scenario.duration);
+    cmd.AddValue("files", "Size of the file catalog", scenario.totalFileCount);
+    cmd.AddValue("maxFilesPerNode", "Maximum number of files a node starts with", scenario.maxFileCountPerNode);
+    cmd.AddValue("zipfExponent", "Exponent of the Zipf popularity of the files", scenario.zipfExponent);
+    cmd.AddValue("minX", "Left edge of the area the nodes move in", scenario.minX);
+    cmd.AddValue("maxX", "Right edge of the area, split into one strip per MPI rank", scenario.maxX);
+    cmd.AddValue("minY", "Bottom edge of the area", scenario.minY);
+    cmd.AddValue("maxY", "Top edge of the area", scenario.maxY);
+    cmd.AddValue("randomPlacement", "Spread the nodes uniformly over the area instead of placing them on a grid", scenario.randomPlacement);
+    cmd.AddValue("outputDir", "Directory for results.txt, summary.csv, nodes.csv and the captures", outputDir);
+    cmd.AddValue("chunkSize", "Bytes of file data per reply", chunkSize);
+    cmd.AddValue("coding", "Exchange random linear combinations of chunks instead of chunks", coding);
+    cmd.AddValue("loadBackoff", "Stretch advertisement and request jitter by 1 + loadBackoff * the measured channel busy share", loadBackoff);
+    cmd.AddValue("maxAdvertisementDeferral", "Seconds past its first due time received packets may push an advertisement back, 0 for no limit", maxAdvertisementDeferral);
+    cmd.AddValue("metricsInterval", "Simulated seconds between two rows of metrics.csv and file-completion.csv, 0 for none", metricsInterval);
+    cmd.AddValue("stopOnConvergence", "Stop once every node has every file", stop_on_convergence);
+    cmd.AddValue("stallWindow", "Also stop when no node gained a chunk for this many simulated seconds, 0 to wait until --duration", stallWindow);
+    cmd.AddValue("pcap", "none, per-node (a radiotap pcap per node), capture (filtered frames into sms16.pcapng) or ring (the last frames, written on anomalies)", pcap);
+    cmd.AddValue("pcapNodes", "Nodes to capture, like 0-9,20, empty for all", pcapNodes);
+    cmd.AddValue("pcapTypes", "Packet types to capture, like request,reply, empty for all frames", pcapTypes);
+    cmd.AddValue("pcapStart", "Simulated second to start capturing at", pcapStart);
+    cmd.AddValue("pcapStop", "Simulated second to stop capturing at, 0 for the end", pcapStop);
+    cmd.AddValue("pcapSnapLength", "Bytes captured per frame, 0 for all", pcapSnapLength);
+    cmd.AddValue("pcapRing", "Frames kept in memory with --pcap=ring", pcapRing);
+    cmd.AddValue("pcapTrigger", "'|' separated patterns, a warning containing one writes the ring", pcapTrigger);
+    cmd.AddValue("pcapCompress", "Pipe the capture through gzip", pcapCompress);
+    cmd.AddValue("eventTrace", "Write a binary protocol event trace to this file (see tools/sms-trace-decode)", eventTrace);
+    cmd.Parse(argc, argv);
+    partition.apply(scenario);
+    if (mkdir(outputDir.c_str(), 0755) != 0 && errno != EEXIST) {
+        NS_LOG_UNCOND("Could not create output directory " << outputDir);
+        partition.disable();
+        return 1;
+    }
+    std::string pcapPrefix = outputDir + "/sms16";
+    std::string metricsPrefix = outputDir + "/";
+    if (partition.is_distributed()) {
+        // Node ids are only unique within a rank
+        std::stringstream suffix;
+        suffix << "-rank" << partition.get_rank();
+        pcapPrefix += suffix.str();
+        if (!eventTrace.empty())
+            eventTrace += suffix.str();
+        metricsPrefix += suffix.str().substr(1) + "-";
+    }
+    if (pcap == "per-node") {
+        scenario.pcapPrefix = pcapPrefix;
+    } else if (pcap == "capture" || pcap == "ring") {
+        if (!capture.set_nodes(pcapNodes) || !capture.set_types(pcapTypes)) {
+            NS_LOG_UNCOND("Invalid --pcapNodes or --pcapTypes");
+            partition.disable();
+            return 1;
+        }
+        capture.set_window(pcapStart, pcapStop);
+        capture.set_snap_length(pcapSnapLength);
+        if (pcap == "ring") {
+            capture.set_ring(pcapRing);
+            capture.set_triggers(pcapTrigger);
+            sms_log_set_watcher(&capture_warning, SMS_LEVEL_WARN);
+        }
+        std::string path = pcapPrefix + ".pcapng" + (pcapCompress ? ".gz" : "");
+        if (!capture.open(path, pcapCompress)) {
+            NS_LOG_UNCOND("Could not open " << path);
+            partition.disable();
+            return 1;
+        }
+    } else if (pcap != "none") {
+        NS_LOG_UNCOND("--pcap has to be none, per-node, capture or ring");
+        partition.disable();
+        return 1;
+    }
+    if (metricsInterval > 0 && !metrics.open(metricsPrefix)) {
+        NS_LOG_UNCOND("Could not open " << metricsPrefix << "metrics.csv");
+        partition.disable();
+        return 1;
+    }
+    if (!eventTrace.empty() && !EventTraceBuffer::open(eventTrace.c_str())) {
+        NS_LOG_UNCOND("Could not open event trace " << eventTrace);
+        partition.disable();
+        return 1;
+    }
+
+    ObjectFactory scheduler;
+    scheduler.SetTypeId("ns3::SmsCountingScheduler");
+    Simulator::SetScheduler(scheduler);
+
     LogComponentEnable("SMSProject", LOG_LEVEL_INFO);
     LogComponentEnable("SmsEchoClientApplication", LOG_LEVEL_WARN);
     NS_LOG_UNCOND("sms16");
+    if (partition.is_distributed()) {
+        NS_LOG_UNCOND("Rank " << partition.get_rank() << " of " << partition.get_num_of_ranks() << ": nodes "
+          << partition.get_first_node() << " to " << partition.get_first_node() + partition.get_num_of_nodes() - 1
+          << ", x from " << scenario.minX << " to " << scenario.maxX);
+    }
+
+    // The file lists of all nodes, in the global node order
+    std::vector< std::vector<FileSMS> > allFileLists;
+    if (partition.is_distributed()) {
+        // Draw them before anything else uses random numbers, so that every
+        // rank draws the same lists
+        generate_file_lists(partition.get_total_nodes(), allFileLists);
+    }
 
     NodeContainer c;
     c.Create(getNumberOfMobileNodes());
@@ -18,30 +260,45 @@ int main(int argc, char* argv[]) {
 
     NetDeviceContainer netDevices;
     installWifi(c, netDevices);
+    if (capture.is_open()) {
+        // Captured by global node id, like --pcapNodes
+        for (uint32_t i = 0; i < netDevices.GetN(); i++) {
+            Ptr<WifiPhy> phy = DynamicCast<WifiNetDevice>(netDevices.Get(i))->GetPhy();
+            uint32_t node = partition.get_first_node() + i;
+            phy->TraceConnectWithoutContext("PhyTxBegin", MakeBoundCallback(&capture_tx, node));
+            phy->TraceConnectWithoutContext("PhyRxEnd", MakeBoundCallback(&capture_rx, node));
+        }
+    }
 
     InternetStackHelper internet;
     internet.Install(c);
 
     Ipv4AddressHelper ipv4;
-    ipv4.SetBase("10.1.1.0", "255.255.255.0");
+    // A /16 so that large scenarios fit, the first 254 nodes keep their 10.1.1.x addresses
+    ipv4.SetBase("10.1.0.0", "255.255.0.0", "0.0.1.1");
     Ipv4InterfaceContainer interfaces = ipv4.Assign(netDevices);
 
-    std::vector< std::vector<FileSMS> > nodeFileList;
+    if (!partition.is_distributed())
+        generate_file_lists(c.GetN(), allFileLists);
+
+    std::vector< std::vector<FileSMS> > nodeFileList(allFileLists.begin() + partition.get_first_node(),
+      allFileLists.begin() + partition.get_first_node() + c.GetN());
     std::set< int > file_set;
 
+    // Only rank 0 writes results
     std::ofstream results;
-    results.open("results.txt");
-    results << "Files per node in the beginning: " << std::endl;
+    if (partition.is_root())
+        results.open((outputDir + "/results.txt").c_str());
+    results << "Files per node in the beginning: \n";
     uint32_t total_num_of_files_in_the_beginning = 0;
-    for (size_t i = 0; i < c.GetN(); i++) {
-        results << "Node " << i << std::endl;
-        std::vector<FileSMS> files = getInitialFileList();
+    for (size_t i = 0; i < allFileLists.size(); i++) {
+        results << "Node " << i << '\n';
+        const std::vector<FileSMS> &files = allFileLists[i];
         total_num_of_files_in_the_beginning += files.size();
         for (size_t j = 0; j < files.size(); j++) {
-          results << "File " << files[j].getFileId() << std::endl;
+          results << "File " << files[j].getFileId() << '\n';
           file_set.insert(files[j].getFileId());
         }
-        nodeFileList.push_back(files);
         // std::vector<FileSMS>::const_iterator it;
         // for (it = files.begin(); it != files.end(); ++it) {
           /* std::cout << "File " << it->getFileId() << " size: " << it->getFileSize() << std::endl; */
@@ -67,46 +324,125 @@ int main(int argc, char* argv[]) {
     client.SetAttribute("MaxPackets", UintegerValue(maxPacketCount));
     client.SetAttribute("Interval", TimeValue(interPacketInterval));
     client.SetAttribute("PacketSize", UintegerValue(packetSize));
+    client.SetAttribute("ChunkSize", UintegerValue(chunkSize));
+    client.SetAttribute("NetworkCoding", BooleanValue(coding));
+    client.SetAttribute("LoadBackoff", DoubleValue(loadBackoff));
+    client.SetAttribute("MaxAdvertisementDeferral", TimeValue(Seconds(maxAdvertisementDeferral)));
     ApplicationContainer apps = client.Install(c);
+    // One stream per node numbered globally, so a node draws the same timers
+    // for a given --RngRun however the nodes are split over MPI ranks
+    client.AssignStreams(c, partition.get_first_node());
     for (uint32_t i = 0; i < c.GetN(); i++) {
       SmsEchoClient* smsApp = static_cast<SmsEchoClient*> (&(*(c.Get(i)->GetApplication(0))));
       smsApp->SetIPAdress(interfaces.Get(i).first->GetAddress(1,0).GetLocal());
       smsApp->SetFiles (nodeFileList[i]);
+      smsApp->TraceConnectWithoutContext("FullFiles", MakeCallback(&file_completed));
+      metrics.add_node(&smsApp->GetProtocol());
+      convergence.add_node(&smsApp->GetProtocol());
     }
+    convergence.set_stall_window(stallWindow);
     // Why does it start at two seconds?
     apps.Start(Seconds(2.0));
-    // apps.Stop(Seconds(10.0)); // That's the Default
-    apps.Stop(Seconds(100));
-    // apps.Stop(Seconds(getSimulationDuration()));
     // It takes around 90 seconds to distribute all files
+    apps.Stop(Seconds(getSimulationDuration()));
+
+    if (metrics.is_open())
+        Simulator::Schedule(Seconds(2.0), &sample_metrics, Seconds(metricsInterval));
+    Simulator::Schedule(Seconds(2.0), &check_convergence);
 
-    Simulator::Stop(Seconds(100));
-    // Simulator::Stop(Seconds(getSimulationDuration()));
+    Simulator::Stop(Seconds(getSimulationDuration()));
     Simulator::Run();
+    if (metrics.is_open() && last_metrics_sample < Simulator::Now().GetSeconds())
+        metrics.sample(Simulator::Now().GetSeconds());
+    metrics.close();
+    if (capture.is_open())
+        NS_LOG_UNCOND("Captured " << capture.get_num_of_frames() << " frames, " << capture.get_num_of_dumps() << " ring dumps");
+    capture.close();
 
     // TODO: statistics for final evaluation
-    results << "Files per node in the end: " << std::endl;
-    std::set< int > file_set_in_the_end;
-    uint32_t total_number_of_full_files = 0;
+    // (node, file id) pairs of the full files of every node, gathered on rank 0
+    std::vector<uint32_t> local_full_files;
+    double timer_events = 0;
     for (uint32_t i = 0; i < c.GetN(); i++) {
-      results << "Node " << i << std::endl;
       SmsEchoClient* smsApp = static_cast<SmsEchoClient*> (&(*(c.Get(i)->GetApplication(0))));
-      std::vector<FileSMSChunks> files_in_the_end = smsApp->files;
+      timer_events += smsApp->GetNumOfTimerEvents();
+      FileTable &files_in_the_end = smsApp->GetProtocol().files;
       for (uint32_t j = 0; j < files_in_the_end.size(); j++) {
         if (files_in_the_end[j].is_full()) {
-          results << "File " << files_in_the_end[j].getFileId() << std::endl;
-          total_number_of_full_files++;
-          file_set_in_the_end.insert(files_in_the_end[j].getFileId());
+          local_full_files.push_back(partition.get_first_node() + i);
+          local_full_files.push_back(files_in_the_end[j].getFileId());
         }
       }
     }
+    std::vector<uint32_t> full_files;
+    partition.gather(local_full_files, full_files);
+    last_completion_time = partition.max(last_completion_time);
+    timer_events = partition.sum(timer_events);
+    double events = partition.sum((double) SmsCountingScheduler::s_numOfEvents);
+    // Ranks stop on their own, the run converged if all of them did
+    double stop_time = partition.max(Simulator::Now().GetSeconds());
+    bool converged = partition.sum(convergence_time < 0 ? 1 : 0) == 0;
+    convergence_time = converged ? partition.max(convergence_time) : -1;
+    if (!partition.is_root()) {
+      Simulator::Destroy();
+      EventTraceBuffer::close();
+      partition.disable();
+      return 0;
+    }
 
-    results << "Stopped at time " << Simulator::Now ().GetSeconds () << " Unique files in the beginning: " << file_set.size() << " Total number of full files in the beginnig: " <<
-    total_num_of_files_in_the_beginning << ", full files in the end: " << total_number_of_full_files << " unique files in the end " << file_set_in_the_end.size() << std::endl;
+    results << "Files per node in the end: \n";
+    std::set< int > file_set_in_the_end;
+    uint32_t total_number_of_full_files = 0;
+    // Ranks hold consecutive nodes, so the pairs arrive sorted by node
+    std::ofstream nodes((outputDir + "/nodes.csv").c_str());
+    nodes << "node,rank,full_files_start,full_files_end\n";
+    size_t next_pair = 0;
+    for (uint32_t i = 0; i < partition.get_total_nodes(); i++) {
+      results << "Node " << i << '\n';
+      uint32_t node_full_files = 0;
+      for (; next_pair < full_files.size() && full_files[next_pair] == i; next_pair += 2) {
+        results << "File " << full_files[next_pair + 1] << '\n';
+        node_full_files++;
+        file_set_in_the_end.insert(full_files[next_pair + 1]);
+      }
+      total_number_of_full_files += node_full_files;
+      nodes << i << "," << partition.get_rank_of_node(i) << "," << allFileLists[i].size() << "," << node_full_files << '\n';
+    }
+    nodes.close();
+
+    results << "Stopped at time " << stop_time << " Unique files in the beginning: " << file_set.size() << " Total number of full files in the beginnig: " <<
+    total_num_of_files_in_the_beginning << ", full files in the end: " << total_number_of_full_files << " unique files in the end " << file_set_in_the_end.size() << '\n';
+    // The applications run from 2 s on
+    // The apps start at 2 s, a run that stops by then has no rate
+    double timer_events_per_second = stop_time > 2.0 ? timer_events / (stop_time - 2.0) : 0;
+    results << "Timer events scheduled: " << timer_events << ", " << timer_events_per_second << " per simulated second\n";
+    results << "Events executed: " << events << '\n';
+    if (converged)
+        results << "Converged at time " << convergence_time << '\n';
+    else
+        results << "Not converged\n";
     results.close();
-    NS_LOG_UNCOND("Stopped at time " << Simulator::Now ().GetSeconds () << " Unique files in the beginning: " << file_set.size() << " Total number of full files in the beginnig: " <<
+    NS_LOG_UNCOND("Stopped at time " << stop_time << " Unique files in the beginning: " << file_set.size() << " Total number of full files in the beginnig: " <<
     total_num_of_files_in_the_beginning << ", full files in the end: " << total_number_of_full_files << " unique files in the end " << file_set_in_the_end.size());
+    NS_LOG_UNCOND("Timer events scheduled: " << timer_events << ", " << timer_events_per_second << " per simulated second");
+    NS_LOG_UNCOND("Events executed: " << events);
+    if (converged)
+        NS_LOG_UNCOND("Converged at time " << convergence_time);
+    else
+        NS_LOG_UNCOND("Not converged");
+
+    // One line per run, tools/sms-sweep aggregates these
+    std::ofstream summary((outputDir + "/summary.csv").c_str());
+    summary << "run,nodes,files,max_files_per_node,duration,unique_files_start,full_files_start,full_files_end,unique_files_end,last_completion_time,timer_events_per_second,convergence_time,stop_time,events\n";
+    summary << RngSeedManager::GetRun() << "," << partition.get_total_nodes() << "," << scenario.totalFileCount << "," << scenario.maxFileCountPerNode << ","
+      << scenario.duration << "," << file_set.size() << "," << total_num_of_files_in_the_beginning << "," << total_number_of_full_files << ","
+      << file_set_in_the_end.size() << "," << last_completion_time << "," << timer_events_per_second << ","
+      << convergence_time << "," << stop_time << "," << events << '\n';
+    summary.close();
 
     Simulator::Destroy();
+    // After Destroy, disposing the applications flushes their last events
+    EventTraceBuffer::close();
+    partition.disable();
     return 0;
 }
@@ -0,0 +1,95 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-metrics.h"
+
+#define METRICS_BUFFER_SIZE (1 << 20)
+
+SmsMetrics::SmsMetrics() : m_metrics(0), m_completion(0) {
+}
+
+SmsMetrics::~SmsMetrics() {
+  close();
+}
+
+bool SmsMetrics::open(const std::string &prefix) {
+  close();
+  m_metrics = fopen((prefix + "metrics.csv").c_str(), "w");
+  m_completion = fopen((prefix + "file-completion.csv").c_str(), "w");
+  if (m_metrics == 0 || m_completion == 0) {
+    close();
+    return false;
+  }
+  m_metrics_buffer.resize(METRICS_BUFFER_SIZE);
+  m_completion_buffer.resize(METRICS_BUFFER_SIZE);
+  setvbuf(m_metrics, &m_metrics_buffer[0], _IOFBF, m_metrics_buffer.size());
+  setvbuf(m_completion, &m_completion_buffer[0], _IOFBF, m_completion_buffer.size());
+
+  fprintf(m_metrics, "time,nodes,full_files,partial_files,chunks_gained,duplicate_chunks");
+  for (int i = 0; i < SMS_NUM_OF_PACKET_TYPES; i++)
+    fprintf(m_metrics, ",%s_packets,%s_bytes", sms_packet_type_name(i), sms_packet_type_name(i));
+  fprintf(m_metrics, "\n");
+  fprintf(m_completion, "time,file_id,full_nodes,share\n");
+  return true;
+}
+
+void SmsMetrics::close() {
+  if (m_metrics != 0)
+    fclose(m_metrics);
+  if (m_completion != 0)
+    fclose(m_completion);
+  m_metrics = 0;
+  m_completion = 0;
+}
+
+void SmsMetrics::add_node(const SmsProtocol* node) {
+  m_nodes.push_back(node);
+  m_counted.push_back(0);
+}
+
+void SmsMetrics::sample(double now) {
+  if (!is_open())
+    return;
+  uint64_t full_files = 0, partial_files = 0, chunks_gained = 0, duplicate_chunks = 0;
+  uint64_t packets[SMS_NUM_OF_PACKET_TYPES] = {0};
+  uint64_t bytes[SMS_NUM_OF_PACKET_TYPES] = {0};
+  for (size_t i = 0; i < m_nodes.size(); i++) {
+    const SmsProtocol &node = *m_nodes[i];
+    full_files += node.GetNumOfFullFiles();
+    partial_files += node.GetNumOfPartialFiles();
+    chunks_gained += node.GetNumOfReceivedChunks();
+    duplicate_chunks += node.GetNumOfDuplicateChunks();
+    for (uint8_t type = 0; type < SMS_NUM_OF_PACKET_TYPES; type++) {
+      packets[type] += node.GetNumOfSentPackets(type);
+      bytes[type] += node.GetNumOfSentBytes(type);
+    }
+
+    // Only the files that became full since the last sample
+    const std::vector<uint32_t> &full = node.files.full_files();
+    for (; m_counted[i] < full.size(); m_counted[i]++) {
+      uint32_t file_id = node.files[full[m_counted[i]]].getFileId();
+      if (file_id >= m_full_nodes.size()) {
+        m_full_nodes.resize(file_id + 1, 0);
+        m_is_changed.resize(file_id + 1, 0);
+      }
+      m_full_nodes[file_id]++;
+      if (!m_is_changed[file_id]) {
+        m_is_changed[file_id] = 1;
+        m_changed.push_back(file_id);
+      }
+    }
+  }
+
+  fprintf(m_metrics, "%g,%u,%llu,%llu,%llu,%llu", now, (unsigned) m_nodes.size(),
+          (unsigned long long) full_files, (unsigned long long) partial_files,
+          (unsigned long long) chunks_gained, (unsigned long long) duplicate_chunks);
+  for (int i = 0; i < SMS_NUM_OF_PACKET_TYPES; i++)
+    fprintf(m_metrics, ",%llu,%llu", (unsigned long long) packets[i], (unsigned long long) bytes[i]);
+  fprintf(m_metrics, "\n");
+
+  double nodes = m_nodes.empty() ? 1 : m_nodes.size();
+  for (size_t i = 0; i < m_changed.size(); i++) {
+    uint32_t file_id = m_changed[i];
+    fprintf(m_completion, "%g,%u,%u,%g\n", now, file_id, m_full_nodes[file_id], m_full_nodes[file_id] / nodes);
+    m_is_changed[file_id] = 0;
+  }
+  m_changed.clear();
+}
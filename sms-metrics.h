@@ -0,0 +1,68 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_METRICS_H
+#define SMS_METRICS_H
+
+#include "sms-protocol.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Samples the counters of all nodes at fixed simulated times into
+ * two CSV files.
+ *
+ * '<prefix>metrics.csv' has one row per sample with totals over the nodes:
+ * full and partial files, chunks gained, duplicate chunks, and packets and
+ * bytes sent of each packet type. All but the file counts add up from the
+ * start of the run.
+ *
+ * '<prefix>file-completion.csv' has a row per file and sample in which more
+ * nodes hold it completely than at the previous one: the sample time, the
+ * file id, the number of such nodes and their share of all nodes, the
+ * completion CDF of the file. The first sample lists the files nodes
+ * start with.
+ *
+ * A sample costs O(nodes + files completed since the last one), rows go
+ * through a large stdio buffer.
+ */
+class SmsMetrics {
+public:
+  SmsMetrics();
+  ~SmsMetrics();
+
+  /**
+   * Opens the files, "run/rank1-" for example as 'prefix'.
+   */
+  bool open(const std::string &prefix);
+  void close();
+  bool is_open() const;
+
+  /**
+   * Adds a node to sample, once its initial files are set. It has to stay
+   * where it is until close().
+   */
+  void add_node(const SmsProtocol* node);
+
+  void sample(double now);
+
+private:
+  FILE* m_metrics;
+  FILE* m_completion;
+  std::vector<char> m_metrics_buffer;
+  std::vector<char> m_completion_buffer;
+
+  std::vector<const SmsProtocol*> m_nodes;
+  // Entries of each node's full_files() already counted
+  std::vector<uint32_t> m_counted;
+  // Nodes holding each file completely, by file id
+  std::vector<uint32_t> m_full_nodes;
+  // File ids whose count changed since the last sample
+  std::vector<uint32_t> m_changed;
+  std::vector<uint8_t> m_is_changed;
+};
+
+inline bool SmsMetrics::is_open() const {
+  return m_metrics != 0;
+}
+
+#endif // SMS_METRICS_H
@@ -0,0 +1,120 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-neighbour-table.h"
+
+NeighbourTable::NeighbourTable(double expiry)
+  : m_expiry(expiry)
+    , m_buckets(16, -1)
+    , m_oldest(-1)
+    , m_newest(-1)
+    , m_num_of_active(0)
+{
+}
+
+void NeighbourTable::set_expiry(double seconds) {
+  m_expiry = seconds;
+}
+
+double NeighbourTable::get_expiry() const {
+  return m_expiry;
+}
+
+uint32_t NeighbourTable::hash_slot(uint32_t address) const {
+  // Fibonacci hashing, addresses of one subnet only differ in the low bits
+  return (address * 2654435769u) & (m_buckets.size() - 1);
+}
+
+int32_t NeighbourTable::find(uint32_t address) const {
+  uint32_t mask = m_buckets.size() - 1;
+  for (uint32_t b = hash_slot(address);; b = (b+1) & mask) {
+    int32_t index = m_buckets[b];
+    if (index == -1 || m_entries[index].address == address)
+      return index;
+  }
+}
+
+void NeighbourTable::rehash(uint32_t capacity) {
+  m_buckets.assign(capacity, -1);
+  for (uint32_t index = 0; index < m_entries.size(); index++) {
+    uint32_t b = hash_slot(m_entries[index].address);
+    while (m_buckets[b] != -1)
+      b = (b+1) & (capacity - 1);
+    m_buckets[b] = index;
+  }
+}
+
+void NeighbourTable::unlink(uint32_t index) {
+  Entry &entry = m_entries[index];
+  if (entry.older != -1)
+    m_entries[entry.older].newer = entry.newer;
+  else
+    m_oldest = entry.newer;
+  if (entry.newer != -1)
+    m_entries[entry.newer].older = entry.older;
+  else
+    m_newest = entry.older;
+  entry.older = -1;
+  entry.newer = -1;
+}
+
+uint32_t NeighbourTable::touch(uint32_t address, double now, bool &became_active) {
+  int32_t index = find(address);
+  if (index == -1) {
+    // Keep the load factor under one half
+    if (2*(m_entries.size()+1) > m_buckets.size())
+      rehash(2*m_buckets.size());
+    index = m_entries.size();
+    Entry entry = {address, now, false, -1, -1};
+    m_entries.push_back(entry);
+    uint32_t mask = m_buckets.size() - 1;
+    uint32_t b = hash_slot(address);
+    while (m_buckets[b] != -1)
+      b = (b+1) & mask;
+    m_buckets[b] = index;
+  }
+  Entry &entry = m_entries[index];
+  became_active = !entry.active;
+  if (entry.active) {
+    unlink(index);
+  } else {
+    entry.active = true;
+    m_active.set(index);
+    m_num_of_active++;
+  }
+  entry.last_seen = now;
+  // Move to the newest end of the active list
+  entry.older = m_newest;
+  if (m_newest != -1)
+    m_entries[m_newest].newer = index;
+  else
+    m_oldest = index;
+  m_newest = index;
+  return index;
+}
+
+void NeighbourTable::expire(double now, std::vector<uint32_t> &expired) {
+  while (m_oldest != -1 && m_entries[m_oldest].last_seen + m_expiry < now) {
+    uint32_t index = m_oldest;
+    unlink(index);
+    m_entries[index].active = false;
+    m_active.reset(index);
+    m_num_of_active--;
+    expired.push_back(index);
+  }
+}
+
+uint32_t NeighbourTable::get_address(uint32_t index) const {
+  return m_entries[index].address;
+}
+
+double NeighbourTable::get_last_seen(uint32_t index) const {
+  return m_entries[index].last_seen;
+}
+
+void NeighbourTable::clear() {
+  m_entries.clear();
+  m_buckets.assign(16, -1);
+  m_oldest = -1;
+  m_newest = -1;
+  m_num_of_active = 0;
+  m_active.clear();
+}
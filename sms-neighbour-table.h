@@ -0,0 +1,97 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_NEIGHBOUR_TABLE_H
+#define SMS_NEIGHBOUR_TABLE_H
+
+#include "sms-dense-bitset.h"
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \brief The nodes we have heard from, numbered densely in the order we
+ * first heard them.
+ *
+ * A neighbour is active from the moment we hear from it until it has been
+ * silent for longer than the expiry time. The active neighbours are kept in
+ * a list ordered by the time they were last heard, so touching a neighbour
+ * and expiring the silent ones costs O(1) per neighbour.
+ *
+ * Indices are never reused, tables built on top of them (e.g. the holders of
+ * a file) stay valid when a neighbour expires and comes back.
+ */
+class NeighbourTable {
+public:
+  explicit NeighbourTable(double expiry = 10.0);
+
+  void set_expiry(double seconds);
+  double get_expiry() const;
+
+  /**
+   * Returns the index of the neighbour with this IPv4 address, adding it if
+   * we have never heard from it, and marks it as heard at 'now'.
+   * 'became_active' is set if it was new or had expired.
+   */
+  uint32_t touch(uint32_t address, double now, bool &became_active);
+
+  /**
+   * Returns the index of the neighbour with this address, or -1.
+   */
+  int32_t find(uint32_t address) const;
+
+  /**
+   * Deactivates the neighbours that have been silent for longer than the
+   * expiry time and appends their indices to 'expired'.
+   */
+  void expire(double now, std::vector<uint32_t> &expired);
+
+  // Number of neighbours ever heard from
+  uint32_t size() const;
+  uint32_t num_of_active() const;
+  bool is_active(uint32_t index) const;
+  // Indices of the active neighbours
+  const DenseBitset& active() const;
+  uint32_t get_address(uint32_t index) const;
+  double get_last_seen(uint32_t index) const;
+
+  void clear();
+
+private:
+  struct Entry {
+    uint32_t address;
+    double last_seen;
+    bool active;
+    // Neighbours in the active list, -1 at the ends
+    int32_t older;
+    int32_t newer;
+  };
+
+  uint32_t hash_slot(uint32_t address) const;
+  void rehash(uint32_t capacity);
+  void unlink(uint32_t index);
+
+  double m_expiry;
+  std::vector<Entry> m_entries;
+  // -1 marks an empty bucket, the capacity is a power of two
+  std::vector<int32_t> m_buckets;
+  int32_t m_oldest;
+  int32_t m_newest;
+  uint32_t m_num_of_active;
+  DenseBitset m_active;
+};
+
+inline uint32_t NeighbourTable::size() const {
+  return m_entries.size();
+}
+
+inline uint32_t NeighbourTable::num_of_active() const {
+  return m_num_of_active;
+}
+
+inline bool NeighbourTable::is_active(uint32_t index) const {
+  return m_entries[index].active;
+}
+
+inline const DenseBitset& NeighbourTable::active() const {
+  return m_active;
+}
+
+#endif // SMS_NEIGHBOUR_TABLE_H
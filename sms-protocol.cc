@@ -0,0 +1,1307 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-protocol.h"
+#include "sms-log.h"
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+#ifdef SMS_NO_EVENT_TRACE
+// sizeof keeps the arguments unevaluated but still counts as a use
+#define TRACE_EVENT(type, peer, file_id, chunk_id, count) \
+  do { (void) sizeof (peer + file_id + chunk_id + count); } while (0)
+#else
+#define TRACE_EVENT(type, peer, file_id, chunk_id, count) \
+  do { \
+    if (EventTraceBuffer::is_enabled ()) \
+      m_eventTrace.record ((uint64_t) (m_host->now () * 1e9 + 0.5), type, peer, file_id, chunk_id, count); \
+  } while (0)
+#endif
+
+FileSMSChunks::FileSMSChunks(unsigned int id, size_t size, bool i_have_full_file, uint16_t chunk_size)
+  : FileSMS(id, size), chunk_size(chunk_size) {
+  file_size_in_chunks = num_of_chunks_for(size, chunk_size);
+  size_of_last_chunk = (1000*size) % chunk_size;
+  // A file that splits evenly ends with a full chunk
+  if (size_of_last_chunk == 0)
+    size_of_last_chunk = chunk_size;
+  chunks = ChunkBitmap(file_size_in_chunks, i_have_full_file);
+  claimed_until = 0;
+  num_of_active_holders = 0;
+  if (!i_have_full_file)
+    num_of_received_chunks = 0;
+  else
+    num_of_received_chunks = file_size_in_chunks;
+}
+
+const char* sms_packet_type_name(uint8_t type) {
+  static const char* names[SMS_NUM_OF_PACKET_TYPES] = {
+    "adv", "request", "reply", "range_request", "coded_request", "coded_reply"
+  };
+  return type < SMS_NUM_OF_PACKET_TYPES ? names[type] : 0;
+}
+
+bool FileSMSChunks::is_full() {
+  return num_of_received_chunks == file_size_in_chunks;
+}
+
+bool FileSMSChunks::seen_in_node(uint32_t neighbour) {
+  return holders.test(neighbour);
+}
+
+uint32_t FileSMSChunks::get_first_missing_chunk() {
+  return chunks.find_first_zero();
+}
+
+// Returns file_size_in_chunks if there is no missing chunk after 'after'
+uint32_t FileSMSChunks::get_next_missing_chunk(uint32_t after) {
+  return chunks.find_next_zero(after+1);
+}
+
+uint32_t FileSMSChunks::get_num_of_missing_chunks_in_range(uint32_t begin, uint32_t end) {
+  return chunks.count_zeros(begin, end);
+}
+
+uint16_t FileSMSChunks::get_size_of_chunk(uint32_t chunk_id) {
+  if (chunk_id == file_size_in_chunks-1) {
+    return size_of_last_chunk;
+  } else {
+    return chunk_size;
+  }
+}
+
+// Marks a missing chunk as on its way to someone else until 'until'
+void FileSMSChunks::claim_chunk(uint32_t chunk_id, double until) {
+  if (claimed.size() == 0)
+    claimed = chunks;
+  claimed.set(chunk_id);
+  claimed_until = MAX(claimed_until, until);
+}
+
+// Returns the bitmap whose zero bits are the chunks worth requesting: the
+// missing ones that no one near us is waiting for, or, if there are none
+// of those, all missing ones
+const ChunkBitmap& FileSMSChunks::get_request_bitmap(double now) {
+  if (claimed.size() == 0)
+    return chunks;
+  if (now >= claimed_until) {
+    claimed = ChunkBitmap();
+    return chunks;
+  }
+  if (claimed.find_first_zero() == file_size_in_chunks) {
+    // Ask anyway, so a reply lost for us doesn't stall the file
+    return chunks;
+  }
+  return claimed;
+}
+
+// Share of the active neighbours which have the file
+double FileSMSChunks::get_popularity(const NeighbourTable &neighbours) const {
+  if (neighbours.num_of_active() == 0)
+    return 0;
+  return num_of_active_holders/((double) neighbours.num_of_active());
+}
+
+uint32_t FileSMSChunks::num_of_chunks_for(size_t size, uint16_t chunk_size) {
+  return (uint32_t) std::ceil(1000*size/((double) chunk_size));
+}
+
+uint32_t FileSMSChunks::get_num_of_missing_chunks() {
+  return file_size_in_chunks - num_of_received_chunks;
+}
+
+// Returns false if we already knew that the neighbour has the file
+bool FileSMSChunks::add_node_to_seen_list(uint32_t neighbour) {
+  if (seen_in_node(neighbour))
+    return false;
+  holders.set(neighbour);
+  return true;
+}
+
+bool RequestIndex::Key::operator<(const Key &other) const {
+  if (missing_chunks != other.missing_chunks)
+    return missing_chunks < other.missing_chunks;
+  if (holders != other.holders)
+    return holders < other.holders;
+  return slot < other.slot;
+}
+
+void RequestIndex::update(uint32_t slot, const FileSMSChunks &file, uint32_t active_holders) {
+  Key empty = {0, 0, slot};
+  if (slot >= m_keys.size())
+    m_keys.resize(slot+1, empty);
+  Key &key = m_keys[slot];
+  Key new_key = {file.file_size_in_chunks - file.num_of_received_chunks,
+    active_holders, slot};
+  if (key.missing_chunks == new_key.missing_chunks && key.holders == new_key.holders)
+    return;
+  if (key.missing_chunks > 0)
+    m_order.erase(key);
+  key = new_key;
+  if (key.missing_chunks > 0)
+    m_order.insert(key);
+}
+
+int32_t RequestIndex::best_file(const DenseBitset &files_of_neighbour, const DenseBitset &partial) const {
+  // The best files are often held by everyone, so try the order first, for
+  // about as many steps as comparing the held files costs
+  uint32_t steps = partial.num_of_words() + 8;
+  std::set<Key>::const_iterator it = m_order.begin();
+  for (; it != m_order.end() && steps > 0; ++it, steps--) {
+    if (files_of_neighbour.test(it->slot))
+      return it->slot;
+  }
+  if (it == m_order.end())
+    return -1;
+  int32_t best = files_of_neighbour.find_next_and(partial, 0);
+  if (best == -1)
+    return -1;
+  for (int32_t slot = files_of_neighbour.find_next_and(partial, best+1); slot != -1;
+       slot = files_of_neighbour.find_next_and(partial, slot+1)) {
+    if (m_keys[slot] < m_keys[best])
+      best = slot;
+  }
+  return best;
+}
+
+void RequestIndex::clear() {
+  m_keys.clear();
+  m_order.clear();
+}
+
+FileTable::FileTable() : m_buckets(16, -1) {
+}
+
+size_t FileTable::size() const {
+  return m_files.size();
+}
+
+FileSMSChunks& FileTable::operator[](size_t slot) {
+  return m_files[slot];
+}
+
+const FileSMSChunks& FileTable::operator[](size_t slot) const {
+  return m_files[slot];
+}
+
+uint32_t FileTable::hash_slot(uint32_t file_id) const {
+  // Fibonacci hashing, the ids of a catalog are mostly consecutive
+  return (file_id * 2654435769u) & (m_buckets.size() - 1);
+}
+
+int32_t FileTable::find(uint32_t file_id) const {
+  uint32_t mask = m_buckets.size() - 1;
+  for (uint32_t b = hash_slot(file_id);; b = (b+1) & mask) {
+    int32_t slot = m_buckets[b];
+    if (slot == -1 || m_files[slot].getFileId() == file_id)
+      return slot;
+  }
+}
+
+uint32_t FileTable::add(const FileSMSChunks &file) {
+  assert(find(file.getFileId()) == -1);
+  // Keep the load factor under one half
+  if (2*(m_files.size()+1) > m_buckets.size())
+    rehash(2*m_buckets.size());
+  uint32_t slot = m_files.size();
+  m_files.push_back(file);
+  if (m_files.back().is_full()) {
+    m_full_files.push_back(slot);
+    m_partial_position.push_back(-1);
+  } else {
+    m_partial_position.push_back(m_partial_files.size());
+    m_partial_files.push_back(slot);
+    m_partial.set(slot);
+  }
+  update_request_index(slot);
+  uint32_t mask = m_buckets.size() - 1;
+  uint32_t b = hash_slot(file.getFileId());
+  while (m_buckets[b] != -1)
+    b = (b+1) & mask;
+  m_buckets[b] = slot;
+  return slot;
+}
+
+void FileTable::rehash(uint32_t capacity) {
+  m_buckets.assign(capacity, -1);
+  for (uint32_t slot = 0; slot < m_files.size(); slot++) {
+    uint32_t b = hash_slot(m_files[slot].getFileId());
+    while (m_buckets[b] != -1)
+      b = (b+1) & (capacity - 1);
+    m_buckets[b] = slot;
+  }
+}
+
+void FileTable::clear() {
+  m_files.clear();
+  m_buckets.assign(16, -1);
+  m_full_files.clear();
+  m_partial_files.clear();
+  m_partial_position.clear();
+  m_partial.clear();
+  m_request_index.clear();
+  m_neighbours.clear();
+  m_files_of_neighbour.clear();
+}
+
+bool FileTable::add_chunk(uint32_t slot, uint32_t chunk_id) {
+  FileSMSChunks &file = m_files[slot];
+  assert(!file.chunks.test(chunk_id));
+  file.chunks.set(chunk_id);
+  if (file.claimed.size() != 0)
+    file.claimed.set(chunk_id);
+  file.num_of_received_chunks+=1;
+  update_request_index(slot);
+  if (!file.is_full())
+    return false;
+  // Swap the completed file out of the partial list
+  uint32_t position = m_partial_position[slot];
+  uint32_t last = m_partial_files.back();
+  m_partial_files[position] = last;
+  m_partial_position[last] = position;
+  m_partial_files.pop_back();
+  m_partial_position[slot] = -1;
+  m_partial.reset(slot);
+  m_full_files.push_back(slot);
+  return true;
+}
+
+uint32_t FileTable::num_of_full_files() const {
+  return m_full_files.size();
+}
+
+uint32_t FileTable::num_of_partial_files() const {
+  return m_partial_files.size();
+}
+
+const std::vector<uint32_t>& FileTable::full_files() const {
+  return m_full_files;
+}
+
+const std::vector<uint32_t>& FileTable::partial_files() const {
+  return m_partial_files;
+}
+
+void FileTable::add_holder(uint32_t slot, uint32_t neighbour) {
+  FileSMSChunks &file = m_files[slot];
+  if (!file.add_node_to_seen_list(neighbour))
+    return;
+  m_files_of_neighbour[neighbour].set(slot);
+  if (m_neighbours.is_active(neighbour))
+    file.num_of_active_holders++;
+  update_request_index(slot);
+}
+
+void FileTable::update_request_index(uint32_t slot) {
+  const FileSMSChunks &file = m_files[slot];
+  m_request_index.update(slot, file, file.num_of_active_holders);
+}
+
+uint32_t FileTable::touch_neighbour(uint32_t node, double now) {
+  bool became_active;
+  uint32_t neighbour = m_neighbours.touch(node, now, became_active);
+  if (neighbour >= m_files_of_neighbour.size())
+    m_files_of_neighbour.resize(neighbour+1);
+  if (became_active)
+    set_holder_active(neighbour);
+  return neighbour;
+}
+
+void FileTable::expire_neighbours(double now) {
+  m_expired.clear();
+  m_neighbours.expire(now, m_expired);
+  for (size_t i = 0; i < m_expired.size(); i++)
+    set_holder_active(m_expired[i]);
+}
+
+// Counts a neighbour that (re)appeared or expired in or out of the active
+// holders of its files and re-ranks the partial ones
+void FileTable::set_holder_active(uint32_t neighbour) {
+  const DenseBitset &files_of_neighbour = m_files_of_neighbour[neighbour];
+  bool active = m_neighbours.is_active(neighbour);
+  for (int32_t slot = files_of_neighbour.find_next(0); slot != -1; slot = files_of_neighbour.find_next(slot+1)) {
+    FileSMSChunks &file = m_files[slot];
+    if (active)
+      file.num_of_active_holders++;
+    else
+      file.num_of_active_holders--;
+    if (!file.is_full())
+      update_request_index(slot);
+  }
+}
+
+void FileTable::set_neighbour_expiry(double seconds) {
+  m_neighbours.set_expiry(seconds);
+}
+
+const NeighbourTable& FileTable::neighbours() const {
+  return m_neighbours;
+}
+
+int32_t FileTable::get_file_to_request(uint32_t node) const {
+  int32_t neighbour = m_neighbours.find(node);
+  if (neighbour == -1)
+    return -1;
+  return m_request_index.best_file(m_files_of_neighbour[neighbour], m_partial);
+}
+
+uint32_t FileTable::num_of_files_to_request(uint32_t node) const {
+  int32_t neighbour = m_neighbours.find(node);
+  if (neighbour == -1)
+    return 0;
+  return m_files_of_neighbour[neighbour].count_and(m_partial);
+}
+
+static void write_u16(uint8_t* &out, uint16_t value) {
+  *out++ = value >> 8;
+  *out++ = value;
+}
+
+static void write_u32(uint8_t* &out, uint32_t value) {
+  *out++ = value >> 24;
+  *out++ = value >> 16;
+  *out++ = value >> 8;
+  *out++ = value;
+}
+
+static uint16_t read_u16(const uint8_t* &in) {
+  uint16_t value = (in[0] << 8) | in[1];
+  in += 2;
+  return value;
+}
+
+static uint32_t read_u32(const uint8_t* &in) {
+  uint32_t value = ((uint32_t) in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+  in += 4;
+  return value;
+}
+
+void SmsProtocol::request_header::serialize(uint8_t* out) const {
+  *out++ = packet_type;
+  write_u32(out, receiver_address);
+  write_u32(out, file_id);
+  write_u32(out, chunk_id);
+}
+
+bool SmsProtocol::request_header::deserialize(const uint8_t* in, size_t length) {
+  if (length < serialized_size)
+    return false;
+  packet_type = *in++;
+  receiver_address = read_u32(in);
+  file_id = read_u32(in);
+  chunk_id = read_u32(in);
+  return true;
+}
+
+void SmsProtocol::reply_header::serialize(uint8_t* out) const {
+  *out++ = packet_type;
+  write_u32(out, original_requester);
+  write_u32(out, file_id);
+  write_u32(out, file_size);
+  write_u32(out, chunk_id);
+  write_u16(out, chunk_size);
+}
+
+bool SmsProtocol::reply_header::deserialize(const uint8_t* in, size_t length) {
+  if (length < serialized_size)
+    return false;
+  packet_type = *in++;
+  original_requester = read_u32(in);
+  file_id = read_u32(in);
+  file_size = read_u32(in);
+  chunk_id = read_u32(in);
+  chunk_size = read_u16(in);
+  return true;
+}
+
+void SmsProtocol::range_request_header::serialize(uint8_t* out) const {
+  *out++ = packet_type;
+  write_u32(out, receiver_address);
+  write_u32(out, file_id);
+  write_u32(out, first_chunk);
+  write_u16(out, num_of_chunks);
+}
+
+bool SmsProtocol::range_request_header::deserialize(const uint8_t* in, size_t length) {
+  if (length < serialized_size)
+    return false;
+  packet_type = *in++;
+  receiver_address = read_u32(in);
+  file_id = read_u32(in);
+  first_chunk = read_u32(in);
+  num_of_chunks = read_u16(in);
+  return true;
+}
+
+void SmsProtocol::coded_request_header::serialize(uint8_t* out) const {
+  *out++ = packet_type;
+  write_u32(out, receiver_address);
+  write_u32(out, file_id);
+  write_u32(out, generation);
+  write_u16(out, generation_size);
+  write_u16(out, num_of_packets);
+}
+
+bool SmsProtocol::coded_request_header::deserialize(const uint8_t* in, size_t length) {
+  if (length < serialized_size)
+    return false;
+  packet_type = *in++;
+  receiver_address = read_u32(in);
+  file_id = read_u32(in);
+  generation = read_u32(in);
+  generation_size = read_u16(in);
+  num_of_packets = read_u16(in);
+  return true;
+}
+
+void SmsProtocol::coded_reply_header::serialize(uint8_t* out) const {
+  *out++ = packet_type;
+  write_u32(out, original_requester);
+  write_u32(out, file_id);
+  write_u32(out, file_size);
+  write_u32(out, generation);
+  write_u32(out, seed);
+  write_u16(out, chunk_size);
+  write_u16(out, generation_size);
+  write_u16(out, remaining);
+}
+
+bool SmsProtocol::coded_reply_header::deserialize(const uint8_t* in, size_t length) {
+  if (length < serialized_size)
+    return false;
+  packet_type = *in++;
+  original_requester = read_u32(in);
+  file_id = read_u32(in);
+  file_size = read_u32(in);
+  generation = read_u32(in);
+  seed = read_u32(in);
+  chunk_size = read_u16(in);
+  generation_size = read_u16(in);
+  remaining = read_u16(in);
+  return true;
+}
+
+SmsProtocolConfig::SmsProtocolConfig()
+  : adv_bloom_threshold(0)
+    , max_chunks_per_request(32)
+    , reply_interval(0.001)
+    , max_reply_queue(256)
+    , neighbour_expiry(10.0)
+    , chunk_size(DEFAULT_CHUNK_SIZE)
+    , overheard_request_timeout(0.1)
+    , network_coding(false)
+    , generation_size(32)
+    , load_backoff(0)
+    , max_advertisement_deferral(0)
+{
+}
+
+SmsProtocol::SmsProtocol()
+  : m_host(0)
+    , address(0)
+    , maximum_full_files_seen(0)
+    , m_receivedChunks(0)
+    , m_duplicateChunks(0)
+    , m_advertisementValid(false)
+    , m_advertisementGeneration(0)
+    , m_advertisementDue(-1)
+    , m_requestNode(0)
+    , m_requestFileId(0)
+    , m_burstPending(false)
+    , m_burstFileId(0)
+    , m_burstLastChunk(0)
+{
+  for (int i = 0; i < SMS_NUM_OF_PACKET_TYPES; i++) {
+    m_sentPackets[i] = 0;
+    m_sentBytes[i] = 0;
+  }
+}
+
+void SmsProtocol::SetHost(SmsProtocolHost* host) {
+  m_host = host;
+}
+
+void SmsProtocol::SetIPAdress(uint32_t address) {
+  this->address = address;
+}
+
+uint32_t SmsProtocol::GetIPAddress() const {
+  return address;
+}
+
+void SmsProtocol::SetFiles(const std::vector<FileSMS> &filesToSet) {
+  files.clear();
+  SMS_LOG_INFO("Node " << SmsAddress(address));
+  for (uint32_t i = 0; i < filesToSet.size(); i++) {
+    files.add(FileSMSChunks(filesToSet[i].getFileId(),filesToSet[i].getFileSize(),true,config.chunk_size));
+  }
+  invalidate_advertisement();
+  maximum_full_files_seen = MAX(maximum_full_files_seen,filesToSet.size());
+}
+
+void SmsProtocol::start(uint32_t node_id) {
+  m_eventTrace.set_node(node_id);
+  files.set_neighbour_expiry(config.neighbour_expiry);
+  m_host->schedule(SMS_TIMER_ADVERTISE, get_time_advertisement(true));
+}
+
+void SmsProtocol::stop() {
+  m_host->cancel(SMS_TIMER_ADVERTISE);
+  m_host->cancel(SMS_TIMER_REQUEST);
+  m_host->cancel(SMS_TIMER_REPLY);
+  m_replyQueue.clear();
+  m_queuedChunks.clear();
+  m_queuedGenerations.clear();
+  m_advertisementDue = -1;
+  m_eventTrace.flush();
+}
+
+void SmsProtocol::on_timer(SmsTimer timer) {
+  switch (timer) {
+  case SMS_TIMER_ADVERTISE:
+    Send();
+    break;
+  case SMS_TIMER_REQUEST:
+    request_packet(m_requestNode, m_requestFileId);
+    break;
+  case SMS_TIMER_REPLY:
+    ServeReplyQueue();
+    break;
+  default:
+    abort();
+  }
+}
+
+uint32_t SmsProtocol::GetNumOfFullFiles() const {
+  return files.num_of_full_files();
+}
+
+uint32_t SmsProtocol::GetNumOfPartialFiles() const {
+  return files.num_of_partial_files();
+}
+
+uint32_t SmsProtocol::GetNumOfReceivedChunks() const {
+  return m_receivedChunks;
+}
+
+uint32_t SmsProtocol::GetNumOfDuplicateChunks() const {
+  return m_duplicateChunks;
+}
+
+uint64_t SmsProtocol::GetNumOfSentPackets(uint8_t packet_type) const {
+  return m_sentPackets[packet_type];
+}
+
+uint64_t SmsProtocol::GetNumOfSentBytes(uint8_t packet_type) const {
+  return m_sentBytes[packet_type];
+}
+
+// Every packet but the advertisement goes out through here
+void SmsProtocol::transmit(const uint8_t* data, size_t length, uint32_t padding) {
+  m_sentPackets[data[0]]++;
+  m_sentBytes[data[0]] += length + padding;
+  m_host->send(data, length, padding);
+}
+
+// Called for every packet we hear, keeps the set of active neighbours current
+void SmsProtocol::addNodeToSeenList(uint32_t sender) {
+  double now = m_host->now();
+  files.expire_neighbours(now);
+  files.touch_neighbour(sender, now);
+}
+
+bool SmsProtocol::add_new_chunk(uint32_t file_id, uint32_t file_size, uint32_t chunk_id, uint32_t sender) {
+  int32_t slot = files.find(file_id);
+  uint32_t num_of_chunks = slot == -1 ? FileSMSChunks::num_of_chunks_for(file_size, config.chunk_size)
+                                      : files[slot].file_size_in_chunks;
+  if (chunk_id >= num_of_chunks) {
+    SMS_LOG_WARN("Chunk " << chunk_id << " is past the end of file " << file_id);
+    return false;
+  }
+  if (slot == -1) {
+    // We haven't seen this file so far
+    slot = files.add(FileSMSChunks(file_id, file_size, false, config.chunk_size));
+    SMS_LOG_INFO("Got new chunk " << chunk_id << " for previously unknown file " << file_id);
+  } else if (!files[slot].chunks.test(chunk_id)) {
+    // We already know about this file
+    SMS_LOG_INFO(SmsAddress(address) << " got new chunk " << chunk_id << " for file " << file_id << " file index in array " << slot);
+  } else {
+    if (!files[slot].is_full())
+      m_duplicateChunks++;
+    return false;
+  }
+  gain_chunk(slot, chunk_id, sender);
+  if (!files[slot].decoders.empty())
+    decode_plain_chunk(slot, chunk_id, sender);
+  return true;
+}
+
+void SmsProtocol::gain_chunk(uint32_t slot, uint32_t chunk_id, uint32_t sender) {
+  FileSMSChunks &file = files[slot];
+  files.add_holder(slot, files.touch_neighbour(sender, m_host->now()));
+  TRACE_EVENT(TRACE_CHUNK_GAINED, sender, file.getFileId(), chunk_id, 1);
+  if (files.add_chunk(slot, chunk_id)) {
+    invalidate_advertisement();
+    TRACE_EVENT(TRACE_FILE_COMPLETED, sender, file.getFileId(), chunk_id, 1);
+  }
+  m_receivedChunks = m_receivedChunks + 1;
+  maximum_full_files_seen = MAX(maximum_full_files_seen,GetNumOfFullFiles());
+  SMS_LOG_INFO("Num of received chunks " << file.num_of_received_chunks);
+}
+
+// A chunk received in the clear counts for the generation we decode as well
+void SmsProtocol::decode_plain_chunk(uint32_t slot, uint32_t chunk_id, uint32_t sender) {
+  uint32_t generation = chunk_id / config.generation_size;
+  std::map<uint32_t, RlncDecoder>::iterator it = files[slot].decoders.find(generation);
+  if (it == files[slot].decoders.end())
+    return;
+  it->second.add_plain(chunk_id - generation*config.generation_size, 0);
+  if (it->second.is_complete())
+    complete_generation(slot, generation, sender);
+}
+
+// Every chunk of a decoded generation is ours now
+void SmsProtocol::complete_generation(uint32_t slot, uint32_t generation, uint32_t sender) {
+  FileSMSChunks &file = files[slot];
+  file.decoders.erase(generation);
+  uint32_t first = generation*config.generation_size;
+  uint32_t end = MIN(first + config.generation_size, file.file_size_in_chunks);
+  SMS_LOG_INFO(SmsAddress(address) << " decoded generation " << generation << " of file " << file.getFileId());
+  for (uint32_t chunk = file.chunks.find_next_zero(first); chunk < end; chunk = file.chunks.find_next_zero(chunk+1))
+    gain_chunk(slot, chunk, sender);
+}
+
+// Returns the slot of the file to request, or -1 if this node has nothing we need
+int32_t SmsProtocol::getFileToRequest(uint32_t node_which_we_ask) {
+  int32_t slot = files.get_file_to_request(node_which_we_ask);
+  // Don't pay for formatting the whole table unless someone reads it
+  if (sms_log_enabled(SMS_LEVEL_INFO)) {
+    std::stringstream ss;
+    ss << "all files which I have: ";
+    for (size_t i = 0; i < files.size(); i++) {
+      ss << "id: " << files[i].getFileId() << " is full? " << files[i].is_full() << ", ";
+    }
+    if (slot != -1) {
+      ss << "CHOSEN FILE TO REQUEST: ID: " << files[slot].getFileId() << ", chunks missing: " << files[slot].get_num_of_missing_chunks() <<
+        " popularity: " << files[slot].get_popularity(files.neighbours()) <<
+        " out of " << files.num_of_files_to_request(node_which_we_ask) << " files " << SmsAddress(node_which_we_ask) << " could give us" << " index: " << slot << ";";
+    }
+    sms_log_write(SMS_LEVEL_INFO, ss.str());
+  }
+  return slot;
+}
+
+// Replaces the content of 'buffer' with the advertisement of our full files
+void SmsProtocol::EncodeFilesForAdv(std::vector<uint8_t> &buffer) {
+  uint32_t full_files = GetNumOfFullFiles();
+  maximum_full_files_seen = MAX(maximum_full_files_seen, full_files);
+  SMS_LOG_INFO("Total files " << files.size() << " full files " << full_files);
+  const std::vector<uint32_t> &full_slots = files.full_files();
+  std::vector<AdvEntry> entries(full_files);
+  for (uint32_t i = 0; i < full_files; i++) {
+    entries[i].file_id = files[full_slots[i]].getFileId();
+    entries[i].file_size = files[full_slots[i]].getFileSize();
+  }
+  adv_encode(entries, config.adv_bloom_threshold, config.chunk_size, buffer);
+}
+
+const std::vector<uint8_t>& SmsProtocol::GetAdvertisement() {
+  if (!m_advertisementValid) {
+    EncodeFilesForAdv(m_advertisement);
+    m_advertisementValid = true;
+  }
+  return m_advertisement;
+}
+
+uint32_t SmsProtocol::get_advertisement_generation() const {
+  return m_advertisementGeneration;
+}
+
+void SmsProtocol::invalidate_advertisement() {
+  m_advertisementValid = false;
+  m_advertisementGeneration++;
+}
+
+// Returns the number of files the sender advertised
+uint32_t SmsProtocol::DecodeFilesForAdv(const uint8_t* raw_array, size_t length, uint32_t sender) {
+  AdvDecoder decoder(raw_array, length);
+  if (!decoder.is_valid()) {
+    SMS_LOG_WARN("Malformed advertisement from " << SmsAddress(sender));
+    return 0;
+  }
+  if (decoder.get_chunk_size() != config.chunk_size) {
+    // Its chunk numbers wouldn't match ours
+    SMS_LOG_WARN(SmsAddress(sender) << " uses chunks of " << decoder.get_chunk_size() << " bytes, we use " << config.chunk_size);
+    return 0;
+  }
+  uint32_t num_advertised_files = decoder.get_num_of_files();
+  uint32_t holder = files.touch_neighbour(sender, m_host->now());
+  if (decoder.get_mode() == ADV_MODE_BLOOM) {
+    // We can only check the files we are still missing against the summary
+    const std::vector<uint32_t> &partial_slots = files.partial_files();
+    for (size_t i = 0; i < partial_slots.size(); i++) {
+      if (decoder.may_contain(files[partial_slots[i]].getFileId()))
+        files.add_holder(partial_slots[i], holder);
+    }
+    maximum_full_files_seen = MAX(maximum_full_files_seen, num_advertised_files);
+    SMS_LOG_INFO("Bloom summary of " << num_advertised_files << " files from " << SmsAddress(sender));
+    return num_advertised_files;
+  }
+  AdvEntry entry;
+  uint32_t new_files = 0;
+  uint32_t num_read = 0;
+  while (decoder.next(entry)) {
+    num_read++;
+    int32_t slot = files.find(entry.file_id);
+    if (slot == -1) {
+      slot = files.add(FileSMSChunks(entry.file_id, entry.file_size, false, config.chunk_size));
+      new_files++;
+      SMS_LOG_INFO("Unknown file seen " << entry.file_id <<
+        " size: " << entry.file_size <<
+        " chunks: " << files[slot].file_size_in_chunks);
+    }
+    files.add_holder(slot, holder);
+  }
+  // Only the files we could read, a corrupt count would skew every delay
+  maximum_full_files_seen = MAX(maximum_full_files_seen, num_read);
+  if (!decoder.is_valid()) {
+    SMS_LOG_WARN("Advertisement from " << SmsAddress(sender) << " was cut short");
+  }
+  if (new_files == 0 && sms_log_enabled(SMS_LEVEL_INFO)) {
+    SMS_LOG_INFO("No new files seen, " << SmsAddress(sender) << " advertised " << num_advertised_files << " files");
+    std::stringstream ss;
+    ss << "Files which I have: ";
+    for (uint32_t i = 0; i < files.num_of_full_files(); i++) {
+      ss << "File " << files[files.full_files()[i]].getFileId() << "; ";
+    }
+    sms_log_write(SMS_LEVEL_INFO, ss.str());
+  }
+  return num_advertised_files;
+}
+
+void SmsProtocol::Send() {
+  m_advertisementDue = -1;
+  const std::vector<uint8_t> &advertisement = GetAdvertisement();
+  m_sentPackets[0]++;
+  m_sentBytes[0] += advertisement.size();
+  m_host->send_advertisement(advertisement, m_advertisementGeneration);
+  TRACE_EVENT(TRACE_ADV_TX, 0, GetNumOfFullFiles(), 0, 0);
+  SMS_LOG_INFO("At time " << m_host->now() << "s client " << SmsAddress(address) << " sent Advertisement");
+}
+
+/*
+IDEA: conservative approach: with 24Mbps one full frame of 1500 bytes
+takes 0.001s to transmit.
+
+So:
+timer for reply:    0s
+timer for request:  (num_of_full_files_i_own+1) * 0.001s
+  maybe even less or maybe
+                    ln(num_of_full_files_i_own+2) * 0.001s
+  or maybe something with sqrt(x)
+timer for advertisement: 50+50*(1/(num_of_full_files_i_own+1))+(random number from -5 to 5)
+*/
+
+double SmsProtocol::get_time_advertisement(bool start) {
+  // All values in milliseconds
+  double offset = maximum_full_files_seen + 10.0;
+  if (start) {
+    offset = 0;
+  }
+  double num_of_full_files_i_own = (double) GetNumOfFullFiles();
+  double multiplier = 50;
+  double random_component = m_host->random()*15*get_load_stretch();
+  double to_seconds = 0.001;
+  return to_seconds*(offset+multiplier*(1.0/num_of_full_files_i_own)+random_component);
+}
+
+// Spreads our transmissions further apart when the channel is busy, so
+// that fewer of them collide
+double SmsProtocol::get_load_stretch() {
+  return 1.0 + config.load_backoff * m_host->channel_busy();
+}
+
+double SmsProtocol::get_time_request() {
+  double num_of_full_files_i_own = (double) GetNumOfFullFiles();
+  double to_seconds = 0.001;
+  double random_component = m_host->random()*10*get_load_stretch();
+  double reply = num_of_full_files_i_own+1.0+random_component;
+  double time_for_advertisement = get_time_advertisement(false);
+  if (to_seconds*reply > time_for_advertisement) {
+    SMS_LOG_WARN("This reply is scheduled with lower priority than an advertisement :o, reply " << to_seconds*reply << " time for advertisement " << time_for_advertisement);
+  }
+  return to_seconds*reply;
+}
+
+// The reply queue keeps being served, we owe those chunks to someone
+void SmsProtocol::cancel_all_events() {
+  m_host->cancel(SMS_TIMER_ADVERTISE);
+  m_host->cancel(SMS_TIMER_REQUEST);
+}
+
+void SmsProtocol::schedule_advertisement() {
+  double delay = get_time_advertisement(false);
+  if (config.max_advertisement_deferral > 0) {
+    double now = m_host->now();
+    if (m_advertisementDue < 0)
+      m_advertisementDue = now + delay;
+    delay = MIN(delay, MAX(0.0, m_advertisementDue + config.max_advertisement_deferral - now));
+  }
+  m_host->schedule(SMS_TIMER_ADVERTISE, delay);
+}
+
+// Asks for the first missing chunk of the file and, if there are more in the
+// next max_chunks_per_request chunks, for those as well in a range request.
+// Chunks we overheard a neighbour ask for are skipped, their replies reach
+// us as well.
+void SmsProtocol::request_packet(uint32_t sender, uint32_t file_id) {
+  FileSMSChunks &file_to_request = files[files.find(file_id)];
+  const ChunkBitmap &wanted_chunks = file_to_request.get_request_bitmap(m_host->now());
+  uint32_t first_chunk = wanted_chunks.find_first_zero();
+  if (first_chunk == file_to_request.file_size_in_chunks) {
+    // Completed by overheard replies since the request was scheduled
+    return;
+  }
+  if (config.network_coding) {
+    request_generation(sender, file_to_request, file_to_request.get_first_missing_chunk());
+    return;
+  }
+  uint32_t end = MIN(first_chunk + config.max_chunks_per_request, file_to_request.file_size_in_chunks);
+  uint32_t num_of_missing_chunks = wanted_chunks.count_zeros(first_chunk, end);
+  SMS_LOG_INFO(SmsAddress(address) << " requesting file " << file_to_request.getFileId() << " chunk number " << first_chunk <<
+    " and " << num_of_missing_chunks - 1 << " more, number of chunk we already have " << file_to_request.num_of_received_chunks << " size of chunk array " << file_to_request.chunks.size());
+  m_burstPending = true;
+  m_burstFileId = file_id;
+  if (num_of_missing_chunks == 1) {
+    request_header request = {.packet_type = 1, .receiver_address = sender,
+      .file_id = file_to_request.getFileId(), .chunk_id = first_chunk};
+    m_burstLastChunk = first_chunk;
+    uint8_t data[request_header::serialized_size];
+    request.serialize(data);
+    transmit(data, sizeof(data), 0);
+  } else {
+    range_request_header request = {.packet_type = 3, .receiver_address = sender,
+      .file_id = file_to_request.getFileId(), .first_chunk = first_chunk, .num_of_chunks = (uint16_t) (end - first_chunk)};
+    std::vector<uint8_t> data(range_request_header::serialized_size + (request.num_of_chunks+7)/8, 0);
+    request.serialize(&data[0]);
+    uint8_t* wanted = &data[range_request_header::serialized_size];
+    for (uint32_t chunk = first_chunk; chunk < end; chunk = wanted_chunks.find_next_zero(chunk+1)) {
+      wanted[(chunk-first_chunk)/8] |= 1 << ((chunk-first_chunk) & 7);
+      m_burstLastChunk = chunk;
+    }
+    transmit(&data[0], data.size(), 0);
+  }
+  TRACE_EVENT(TRACE_REQUEST_TX, sender, file_id, first_chunk, num_of_missing_chunks);
+}
+
+// Asks for as many coded packets of the generation of 'first_missing' as we
+// lack to decode it
+void SmsProtocol::request_generation(uint32_t sender, FileSMSChunks &file, uint32_t first_missing) {
+  uint32_t generation = first_missing / config.generation_size;
+  uint32_t first = generation*config.generation_size;
+  uint32_t end = MIN(first + config.generation_size, file.file_size_in_chunks);
+  std::map<uint32_t, RlncDecoder>::const_iterator it = file.decoders.find(generation);
+  uint32_t rank = it != file.decoders.end() ? it->second.rank() : (end - first) - file.chunks.count_zeros(first, end);
+  coded_request_header request = {.packet_type = 4, .receiver_address = sender,
+    .file_id = file.getFileId(), .generation = generation, .generation_size = config.generation_size,
+    .num_of_packets = (uint16_t) (end - first - rank)};
+  SMS_LOG_INFO(SmsAddress(address) << " requesting " << request.num_of_packets << " coded packets of generation " <<
+    generation << " of file " << file.getFileId());
+  m_burstPending = true;
+  m_burstFileId = file.getFileId();
+  m_burstLastChunk = end - 1;
+  uint8_t data[coded_request_header::serialized_size];
+  request.serialize(data);
+  transmit(data, sizeof(data), 0);
+  TRACE_EVENT(TRACE_REQUEST_TX, sender, file.getFileId(), first, request.num_of_packets);
+}
+
+void SmsProtocol::queue_reply(uint32_t requester, uint32_t slot, uint32_t chunk_id) {
+  uint64_t key = ((uint64_t) files[slot].getFileId() << 32) | chunk_id;
+  if (m_queuedChunks.count(key)) {
+    SMS_LOG_INFO(SmsAddress(address) << " already has chunk " << chunk_id << " queued, " << SmsAddress(requester) << " hears it as well");
+    return;
+  }
+  if (m_replyQueue.size() >= config.max_reply_queue) {
+    SMS_LOG_WARN(SmsAddress(address) << " reply queue is full, dropping chunk " << chunk_id << " for " << SmsAddress(requester));
+    return;
+  }
+  reply_header reply;
+  reply.packet_type = 2;
+  reply.original_requester = requester;
+  reply.file_id = files[slot].getFileId();
+  reply.file_size = (uint32_t) files[slot].getFileSize();
+  reply.chunk_id = chunk_id;
+  reply.chunk_size = config.chunk_size;
+  m_replyQueue.push_back(reply);
+  m_queuedChunks.insert(key);
+  if (!m_host->is_pending(SMS_TIMER_REPLY)) {
+    m_host->schedule(SMS_TIMER_REPLY, 0);
+  }
+}
+
+// Everyone who misses a generation can use any of its coded packets, so we
+// only top up what is already queued for it
+void SmsProtocol::queue_coded_replies(uint32_t requester, uint32_t slot, uint32_t generation, uint16_t num_of_packets) {
+  uint64_t key = ((uint64_t) files[slot].getFileId() << 32) | generation;
+  uint32_t &queued = m_queuedGenerations[key];
+  reply_header job;
+  job.packet_type = 5;
+  job.original_requester = requester;
+  job.file_id = files[slot].getFileId();
+  job.file_size = (uint32_t) files[slot].getFileSize();
+  job.chunk_id = generation;
+  job.chunk_size = config.chunk_size;
+  while (queued < num_of_packets) {
+    if (m_replyQueue.size() >= config.max_reply_queue) {
+      SMS_LOG_WARN(SmsAddress(address) << " reply queue is full, dropping coded packets of generation " << generation << " for " << SmsAddress(requester));
+      break;
+    }
+    m_replyQueue.push_back(job);
+    queued++;
+  }
+  if (queued == 0) {
+    m_queuedGenerations.erase(key);
+    return;
+  }
+  if (!m_host->is_pending(SMS_TIMER_REPLY)) {
+    m_host->schedule(SMS_TIMER_REPLY, 0);
+  }
+}
+
+void SmsProtocol::send_coded_reply(const reply_header &job) {
+  uint32_t remaining = 0;
+  std::map<uint64_t, uint32_t>::iterator it = m_queuedGenerations.find(((uint64_t) job.file_id << 32) | job.chunk_id);
+  if (it != m_queuedGenerations.end()) {
+    remaining = --it->second;
+    if (remaining == 0)
+      m_queuedGenerations.erase(it);
+  }
+  coded_reply_header reply;
+  reply.packet_type = 5;
+  reply.original_requester = job.original_requester;
+  reply.file_id = job.file_id;
+  reply.file_size = job.file_size;
+  reply.generation = job.chunk_id;
+  reply.seed = (uint32_t) (m_host->random() * 4294967295.0);
+  reply.chunk_size = config.chunk_size;
+  reply.generation_size = config.generation_size;
+  reply.remaining = (uint16_t) MIN(remaining, 0xFFFF);
+  // A combination is as long as the longest chunk it combines, the first
+  // one of the generation
+  uint32_t first = job.chunk_id*config.generation_size;
+  uint16_t chunk_size = files[files.find(job.file_id)].get_size_of_chunk(first);
+  SMS_LOG_INFO("Sending coded reply, file ID: " << job.file_id << ", generation: " << job.chunk_id);
+  uint8_t data[coded_reply_header::serialized_size];
+  reply.serialize(data);
+  transmit(data, sizeof(data), chunk_size);
+  TRACE_EVENT(TRACE_REPLY_TX, job.original_requester, job.file_id, first, 1);
+}
+
+void SmsProtocol::ServeReplyQueue() {
+  reply_header reply = m_replyQueue.front();
+  m_replyQueue.pop_front();
+  if (reply.packet_type == 5) {
+    send_coded_reply(reply);
+    if (!m_replyQueue.empty()) {
+      m_host->schedule(SMS_TIMER_REPLY, config.reply_interval);
+    }
+    return;
+  }
+  m_queuedChunks.erase(((uint64_t) reply.file_id << 32) | reply.chunk_id);
+  uint16_t chunk_size = files[files.find(reply.file_id)].get_size_of_chunk(reply.chunk_id);
+  SMS_LOG_INFO("Sending reply, file ID: " << reply.file_id << ", chunk_id: " << reply.chunk_id);
+  uint8_t data[reply_header::serialized_size];
+  reply.serialize(data);
+  // The chunk content doesn't matter, only its size does
+  transmit(data, sizeof(data), chunk_size);
+  TRACE_EVENT(TRACE_REPLY_TX, reply.original_requester, reply.file_id, reply.chunk_id, 1);
+  if (!m_replyQueue.empty()) {
+    m_host->schedule(SMS_TIMER_REPLY, config.reply_interval);
+  }
+}
+
+// Handles everything that's broadcast
+void SmsProtocol::handle_packet(uint32_t sender, const uint8_t* data, size_t length) {
+  addNodeToSeenList(sender);
+  if (length == 0) {
+    SMS_LOG_WARN("Got an empty packet from " << SmsAddress(sender));
+    return;
+  }
+  switch (data[0]) {
+  case 0:
+    handle_advertisement(sender, data, length);
+    break;
+  case 1:
+    handle_request(sender, data, length);
+    break;
+  case 3:
+    handle_range_request(sender, data, length);
+    break;
+  case 2:
+    handle_reply(sender, data, length);
+    break;
+  case 4:
+    handle_coded_request(sender, data, length);
+    break;
+  case 5:
+    handle_coded_reply(sender, data, length);
+    break;
+  default:
+    SMS_LOG_WARN("Got some weird packet type :o at time " << m_host->now() << "s client " <<
+      SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+    abort();
+  }
+}
+
+void SmsProtocol::handle_advertisement(uint32_t sender, const uint8_t* data, size_t length) {
+  cancel_all_events();
+  SMS_LOG_INFO("Packet is an advertisement at time " << m_host->now() << "s client " <<
+    SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+  uint32_t num_advertised_files = DecodeFilesForAdv(data, length, sender);
+  TRACE_EVENT(TRACE_ADV_RX, sender, num_advertised_files, 0, 0);
+  int32_t file_to_request = getFileToRequest(sender);
+  if (file_to_request == -1) {
+    SMS_LOG_WARN("No more files to request for node " << SmsAddress(address) << " at time " << m_host->now());
+    // Maybe here we shouldn't advertise again and just shut up. Then the simulation would end automatically
+    schedule_advertisement();
+    return;
+  }
+  m_requestNode = sender;
+  m_requestFileId = files[file_to_request].getFileId();
+  m_host->schedule(SMS_TIMER_REQUEST, get_time_request());
+  schedule_advertisement();
+}
+
+void SmsProtocol::handle_request(uint32_t sender, const uint8_t* data, size_t length) {
+  cancel_all_events();
+  request_header request;
+  if (!request.deserialize(data, length)) {
+    SMS_LOG_WARN("Truncated request from " << SmsAddress(sender));
+    schedule_advertisement();
+    return;
+  }
+  if (request.receiver_address != address) {
+    int32_t slot = find_claimable_file(request.file_id, request.receiver_address);
+    if (slot != -1 && request.chunk_id < files[slot].file_size_in_chunks && !files[slot].chunks.test(request.chunk_id))
+      files[slot].claim_chunk(request.chunk_id, m_host->now() + config.overheard_request_timeout);
+    schedule_advertisement();
+    return;
+  }
+  TRACE_EVENT(TRACE_REQUEST_RX, sender, request.file_id, request.chunk_id, 1);
+  SMS_LOG_INFO("Packet is a request, requesting " << request.file_id << ", chunk " << request.chunk_id <<
+    " at time " << m_host->now() << "s client " <<
+    SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+  int32_t slot = files.find(request.file_id);
+  if (slot == -1 || request.chunk_id >= files[slot].file_size_in_chunks || !files[slot].chunks.test(request.chunk_id)) {
+    // Can happen when a Bloom summary gave a false positive
+    SMS_LOG_WARN("Requested chunk " << request.chunk_id << " of file " << request.file_id << " which we don't have");
+    schedule_advertisement();
+    return;
+  }
+  queue_reply(sender, slot, request.chunk_id);
+  schedule_advertisement();
+}
+
+void SmsProtocol::handle_range_request(uint32_t sender, const uint8_t* data, size_t length) {
+  cancel_all_events();
+  range_request_header request;
+  if (!request.deserialize(data, length)) {
+    SMS_LOG_WARN("Truncated range request from " << SmsAddress(sender));
+    schedule_advertisement();
+    return;
+  }
+  if (request.receiver_address != address) {
+    int32_t slot = find_claimable_file(request.file_id, request.receiver_address);
+    if (slot != -1 && length >= range_request_header::serialized_size + (request.num_of_chunks+7)/8) {
+      FileSMSChunks &file = files[slot];
+      const uint8_t* wanted = data + range_request_header::serialized_size;
+      double until = m_host->now() + config.overheard_request_timeout;
+      for (uint32_t i = 0; i < request.num_of_chunks; i++) {
+        uint32_t chunk = request.first_chunk + i;
+        if ((wanted[i/8] & (1 << (i & 7))) && chunk < file.file_size_in_chunks && !file.chunks.test(chunk))
+          file.claim_chunk(chunk, until);
+      }
+    }
+    schedule_advertisement();
+    return;
+  }
+  TRACE_EVENT(TRACE_REQUEST_RX, sender, request.file_id, request.first_chunk, request.num_of_chunks);
+  SMS_LOG_INFO("Packet is a range request, requesting " << request.file_id << ", chunks " << request.first_chunk <<
+    " to " << request.first_chunk + request.num_of_chunks - 1 <<
+    " at time " << m_host->now() << "s client " <<
+    SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+  int32_t slot = files.find(request.file_id);
+  if (slot == -1 || length < range_request_header::serialized_size + (request.num_of_chunks+7)/8) {
+    SMS_LOG_WARN("Range request for file " << request.file_id << " which we don't have");
+    schedule_advertisement();
+    return;
+  }
+  const uint8_t* wanted = data + range_request_header::serialized_size;
+  for (uint32_t i = 0; i < request.num_of_chunks; i++) {
+    uint32_t chunk = request.first_chunk + i;
+    if ((wanted[i/8] & (1 << (i & 7))) && chunk < files[slot].file_size_in_chunks && files[slot].chunks.test(chunk))
+      queue_reply(sender, slot, chunk);
+  }
+  schedule_advertisement();
+}
+
+// Returns the slot of a file of ours someone near us is downloading as well
+// from 'holder', or -1 if we wouldn't hear the replies or don't track what
+// others ask for
+int32_t SmsProtocol::find_claimable_file(uint32_t file_id, uint32_t holder) {
+  if (config.overheard_request_timeout <= 0)
+    return -1;
+  int32_t neighbour = files.neighbours().find(holder);
+  if (neighbour == -1 || !files.neighbours().is_active(neighbour))
+    return -1;
+  int32_t slot = files.find(file_id);
+  if (slot == -1 || files[slot].is_full())
+    return -1;
+  return slot;
+}
+
+void SmsProtocol::handle_reply(uint32_t sender, const uint8_t* data, size_t length) {
+  cancel_all_events();
+  SMS_LOG_INFO("Packet is a reply at time " << m_host->now() << "s client " <<
+    SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+  reply_header reply;
+  if (!reply.deserialize(data, length)) {
+    SMS_LOG_WARN("Truncated reply from " << SmsAddress(sender));
+    schedule_advertisement();
+    return;
+  }
+  TRACE_EVENT(TRACE_REPLY_RX, sender, reply.file_id, reply.chunk_id, 1);
+  if (reply.chunk_size != config.chunk_size) {
+    SMS_LOG_WARN(SmsAddress(sender) << " sent a chunk of a " << reply.chunk_size << " byte split, we use " << config.chunk_size);
+    schedule_advertisement();
+    return;
+  }
+  add_new_chunk(reply.file_id, reply.file_size, reply.chunk_id, sender);
+  // Only ask again once the burst we asked for is over, if its last chunk
+  // gets lost the next advertisement gets things going again
+  bool burst_over = !m_burstPending || (reply.file_id == m_burstFileId && reply.chunk_id == m_burstLastChunk);
+  // The holder sends a chunk two nodes asked for only once, to the first of
+  // them, so the end of our burst may be addressed to someone else
+  bool for_us = reply.original_requester == address || (m_burstPending && burst_over);
+  if (for_us && burst_over) {
+    // We are allowed to request again :)
+    m_burstPending = false;
+    request_next(sender);
+  }
+  schedule_advertisement();
+}
+
+// Asks 'sender', whose burst for us just ended, for more right away
+void SmsProtocol::request_next(uint32_t sender) {
+  int32_t file_to_request = getFileToRequest(sender);
+  if (file_to_request == -1) {
+    SMS_LOG_WARN("No more files to request for node " << SmsAddress(address) << " at time " << m_host->now());
+    return;
+  }
+  m_requestNode = sender;
+  m_requestFileId = files[file_to_request].getFileId();
+  m_host->schedule(SMS_TIMER_REQUEST, 0);
+}
+
+void SmsProtocol::handle_coded_request(uint32_t sender, const uint8_t* data, size_t length) {
+  cancel_all_events();
+  coded_request_header request;
+  if (!request.deserialize(data, length)) {
+    SMS_LOG_WARN("Truncated coded request from " << SmsAddress(sender));
+    schedule_advertisement();
+    return;
+  }
+  if (request.receiver_address != address) {
+    schedule_advertisement();
+    return;
+  }
+  TRACE_EVENT(TRACE_REQUEST_RX, sender, request.file_id, request.generation*request.generation_size, request.num_of_packets);
+  SMS_LOG_INFO("Packet is a coded request, requesting " << request.num_of_packets << " packets of generation " <<
+    request.generation << " of file " << request.file_id << " at time " << m_host->now() << "s client " <<
+    SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+  if (request.generation_size != config.generation_size) {
+    SMS_LOG_WARN(SmsAddress(sender) << " codes generations of " << request.generation_size << " chunks, we use " << config.generation_size);
+    schedule_advertisement();
+    return;
+  }
+  int32_t slot = files.find(request.file_id);
+  uint64_t first = (uint64_t) request.generation*config.generation_size;
+  if (slot == -1 || first >= files[slot].file_size_in_chunks ||
+      files[slot].chunks.count_zeros(first, first + config.generation_size) != 0) {
+    // We can only combine chunks we have
+    SMS_LOG_WARN("Coded request for generation " << request.generation << " of file " << request.file_id << " which we don't have");
+    schedule_advertisement();
+    return;
+  }
+  queue_coded_replies(sender, slot, request.generation, request.num_of_packets);
+  schedule_advertisement();
+}
+
+void SmsProtocol::handle_coded_reply(uint32_t sender, const uint8_t* data, size_t length) {
+  cancel_all_events();
+  SMS_LOG_INFO("Packet is a coded reply at time " << m_host->now() << "s client " <<
+    SmsAddress(address) << " received " << length << " bytes from " << SmsAddress(sender));
+  coded_reply_header reply;
+  if (!reply.deserialize(data, length)) {
+    SMS_LOG_WARN("Truncated coded reply from " << SmsAddress(sender));
+    schedule_advertisement();
+    return;
+  }
+  if (reply.chunk_size != config.chunk_size || reply.generation_size != config.generation_size) {
+    SMS_LOG_WARN(SmsAddress(sender) << " codes generations of " << reply.generation_size << " chunks of " << reply.chunk_size <<
+      " bytes, we use " << config.generation_size << " of " << config.chunk_size);
+    schedule_advertisement();
+    return;
+  }
+  uint64_t first = (uint64_t) reply.generation*config.generation_size;
+  TRACE_EVENT(TRACE_REPLY_RX, sender, reply.file_id, first, 1);
+  if (first >= FileSMSChunks::num_of_chunks_for(reply.file_size, config.chunk_size)) {
+    SMS_LOG_WARN("Generation " << reply.generation << " is past the end of file " << reply.file_id);
+    schedule_advertisement();
+    return;
+  }
+  int32_t slot = files.find(reply.file_id);
+  if (slot == -1) {
+    slot = files.add(FileSMSChunks(reply.file_id, reply.file_size, false, config.chunk_size));
+    SMS_LOG_INFO("Got coded packet for previously unknown file " << reply.file_id);
+  }
+  FileSMSChunks &file = files[slot];
+  uint32_t end = MIN(first + config.generation_size, file.file_size_in_chunks);
+  if (file.chunks.count_zeros(first, end) == 0) {
+    if (!file.is_full())
+      m_duplicateChunks++;
+  } else {
+    std::map<uint32_t, RlncDecoder>::iterator it = file.decoders.find(reply.generation);
+    if (it == file.decoders.end()) {
+      it = file.decoders.insert(std::make_pair(reply.generation, RlncDecoder(end - first, 0))).first;
+      for (uint32_t chunk = first; chunk < end; chunk++) {
+        if (file.chunks.test(chunk))
+          it->second.add_plain(chunk - first, 0);
+      }
+    }
+    m_coefficients.resize(end - first);
+    rlnc_coefficients(reply.seed, &m_coefficients[0], end - first);
+    if (!it->second.add_coded(&m_coefficients[0], 0)) {
+      m_duplicateChunks++;
+    } else {
+      files.add_holder(slot, files.touch_neighbour(sender, m_host->now()));
+      if (it->second.is_complete())
+        complete_generation(slot, reply.generation, sender);
+    }
+  }
+  // Our burst is over once its generation is decoded or the holder has
+  // nothing more queued for it
+  bool burst_over = !m_burstPending || (reply.file_id == m_burstFileId && m_burstLastChunk >= first &&
+    m_burstLastChunk < end && (reply.remaining == 0 || file.chunks.test(m_burstLastChunk)));
+  bool for_us = reply.original_requester == address || (m_burstPending && burst_over);
+  if (for_us && burst_over) {
+    m_burstPending = false;
+    request_next(sender);
+  }
+  schedule_advertisement();
+}
@@ -0,0 +1,495 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_PROTOCOL_H
+#define SMS_PROTOCOL_H
+
+#include "sms-file.h"
+#include "sms-chunk-bitmap.h"
+#include "sms-adv-codec.h"
+#include "sms-event-trace.h"
+#include "sms-neighbour-table.h"
+#include "sms-dense-bitset.h"
+#include "sms-rlnc.h"
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+/*
+ * The dissemination protocol without any ns-3 dependency. A driver owns one
+ * SmsProtocol per node and implements SmsProtocolHost for it: the clock,
+ * timers, randomness and a broadcast medium. SmsEchoClient is the ns-3
+ * driver, tools/sms-contact-sim runs the same code on a contact graph.
+ *
+ * Addresses are IPv4 addresses kept as host order integers.
+ */
+
+// Default of SmsProtocolConfig::chunk_size
+#define DEFAULT_CHUNK_SIZE 1450
+// The first byte of every packet: 0 advertisement, 1 request, 2 reply,
+// 3 range request, 4 coded request, 5 coded reply
+#define SMS_NUM_OF_PACKET_TYPES 6
+
+/**
+ * "adv", "request", "reply", "range_request", "coded_request" or
+ * "coded_reply", 0 for other types.
+ */
+const char* sms_packet_type_name(uint8_t type);
+
+class FileSMSChunks : public FileSMS {
+public:
+  FileSMSChunks(unsigned int id, size_t size, bool i_have_full_file, uint16_t chunk_size);
+
+  // Chunks of a file of size kB
+  static uint32_t num_of_chunks_for(size_t size, uint16_t chunk_size);
+
+  ChunkBitmap chunks;
+  uint16_t chunk_size;
+  uint16_t size_of_last_chunk;
+  uint32_t file_size_in_chunks;
+  uint32_t num_of_received_chunks;
+  // Neighbour indices of the nodes that have the whole file
+  DenseBitset holders;
+  // How many of them are active, kept up to date by FileTable
+  uint32_t num_of_active_holders;
+  // The chunks we have plus the missing ones a node near us asked for
+  // before claimed_until. Empty while no such request is outstanding.
+  ChunkBitmap claimed;
+  double claimed_until;
+  // Generations we got coded packets for but haven't decoded yet
+  std::map<uint32_t, RlncDecoder> decoders;
+
+  uint32_t get_first_missing_chunk();
+  uint32_t get_next_missing_chunk(uint32_t after);
+  uint32_t get_num_of_missing_chunks_in_range(uint32_t begin, uint32_t end);
+  uint32_t get_num_of_missing_chunks ();
+  uint16_t get_size_of_chunk(uint32_t chunk_id);
+  void claim_chunk(uint32_t chunk_id, double until);
+  const ChunkBitmap& get_request_bitmap(double now);
+  bool add_node_to_seen_list(uint32_t neighbour);
+  bool seen_in_node(uint32_t neighbour);
+  double get_popularity(const NeighbourTable &neighbours) const;
+  bool is_full();
+};
+
+/**
+ * \brief Orders the partial files the way getFileToRequest picks them:
+ * fewest missing chunks first, then fewest active holders (i.e. lowest
+ * popularity), then the oldest slot.
+ *
+ * There is one order for all neighbours, so updating a file costs
+ * O(log(files)) however many nodes hold it. Picking a file for a neighbour
+ * walks the order for a few steps and then compares the partial files the
+ * neighbour holds, O(files/64 + held files) at worst.
+ */
+class RequestIndex {
+public:
+  /**
+   * Re-files 'slot' after its number of missing chunks or of active holders
+   * changed. Full files are dropped from the index.
+   */
+  void update(uint32_t slot, const FileSMSChunks &file, uint32_t active_holders);
+
+  /**
+   * Returns the best of the slots in both 'files_of_neighbour', the files
+   * a neighbour holds, and 'partial', or -1.
+   */
+  int32_t best_file(const DenseBitset &files_of_neighbour, const DenseBitset &partial) const;
+
+  void clear();
+
+private:
+  struct Key {
+    uint32_t missing_chunks;
+    uint32_t holders;
+    uint32_t slot;
+    bool operator<(const Key &other) const;
+  };
+
+  // Indexed by slot, missing_chunks is 0 for the slots not in m_order
+  std::vector<Key> m_keys;
+  std::set<Key> m_order;
+};
+
+/**
+ * \brief The files a node knows about, looked up by file id.
+ *
+ * Files are only ever added, so the slot returned by add() and find() stays
+ * valid for the lifetime of the table, and so do references to the files.
+ * The id to slot map uses open addressing, a lookup doesn't allocate.
+ *
+ * The table also keeps the slots of the full and of the partial files and
+ * the request index up to date, which is why new chunks and holders have to
+ * be stored through add_chunk() and add_holder().
+ *
+ * Holders are neighbours of the NeighbourTable. Popularity only counts the
+ * active ones, so neighbours have to be heard and expired through
+ * touch_neighbour() and expire_neighbours().
+ */
+class FileTable {
+public:
+  FileTable();
+
+  size_t size() const;
+  FileSMSChunks& operator[](size_t slot);
+  const FileSMSChunks& operator[](size_t slot) const;
+
+  /**
+   * Returns the slot of the file with this id, or -1 if it is unknown.
+   */
+  int32_t find(uint32_t file_id) const;
+
+  /**
+   * Adds a file whose id is not in the table yet and returns its slot.
+   */
+  uint32_t add(const FileSMSChunks &file);
+  void clear();
+
+  /**
+   * Marks a missing chunk of the file in 'slot' as received.
+   * Returns true if this chunk completed the file.
+   */
+  bool add_chunk(uint32_t slot, uint32_t chunk_id);
+
+  /**
+   * Records that 'neighbour' has the file in 'slot' completely.
+   */
+  void add_holder(uint32_t slot, uint32_t neighbour);
+
+  /**
+   * Returns the neighbour index of 'node' after marking it as heard at 'now'.
+   */
+  uint32_t touch_neighbour(uint32_t node, double now);
+  void expire_neighbours(double now);
+  void set_neighbour_expiry(double seconds);
+  const NeighbourTable& neighbours() const;
+
+  /**
+   * Returns the slot of the partial file to request from 'node', or -1 if
+   * it doesn't hold any file we are missing.
+   */
+  int32_t get_file_to_request(uint32_t node) const;
+
+  /**
+   * Returns the number of our partial files that 'node' has completely.
+   */
+  uint32_t num_of_files_to_request(uint32_t node) const;
+
+  uint32_t num_of_full_files() const;
+  uint32_t num_of_partial_files() const;
+  // Slots of the full files, in the order they became full
+  const std::vector<uint32_t>& full_files() const;
+  // Slots of the files we have seen but not completed, in no particular order
+  const std::vector<uint32_t>& partial_files() const;
+
+private:
+  uint32_t hash_slot(uint32_t file_id) const;
+  void rehash(uint32_t capacity);
+  void set_holder_active(uint32_t neighbour);
+  void update_request_index(uint32_t slot);
+
+  std::deque<FileSMSChunks> m_files;
+  // -1 marks an empty bucket, the capacity is a power of two
+  std::vector<int32_t> m_buckets;
+
+  std::vector<uint32_t> m_full_files;
+  std::vector<uint32_t> m_partial_files;
+  // Position of each slot in m_partial_files, -1 once the file is full
+  std::vector<int32_t> m_partial_position;
+  // The same slots as m_partial_files, to intersect with m_files_of_neighbour
+  DenseBitset m_partial;
+
+  RequestIndex m_request_index;
+
+  NeighbourTable m_neighbours;
+  // Slots of the files each neighbour holds
+  std::vector<DenseBitset> m_files_of_neighbour;
+  // Scratch list for expire_neighbours()
+  std::vector<uint32_t> m_expired;
+};
+
+enum SmsTimer {
+  SMS_TIMER_ADVERTISE = 0,
+  SMS_TIMER_REQUEST,
+  SMS_TIMER_REPLY,
+  SMS_NUM_OF_TIMERS
+};
+
+/**
+ * \brief What a driver provides to the protocol of one node.
+ */
+class SmsProtocolHost {
+public:
+  virtual ~SmsProtocolHost() {}
+
+  // Current time in seconds
+  virtual double now() const = 0;
+  // Uniform in [0, 1]
+  virtual double random() = 0;
+  // Share of the recent airtime the channel around us was busy, in [0, 1].
+  // Hosts without a radio model may leave it at 0.
+  virtual double channel_busy() { return 0; }
+
+  /**
+   * Makes SmsProtocol::on_timer(timer) run after 'delay' seconds, replacing
+   * a pending run of the same timer.
+   */
+  virtual void schedule(SmsTimer timer, double delay) = 0;
+  virtual void cancel(SmsTimer timer) = 0;
+  virtual bool is_pending(SmsTimer timer) const = 0;
+
+  /**
+   * Broadcasts 'length' bytes followed by 'padding' bytes whose content
+   * doesn't matter.
+   */
+  virtual void send(const uint8_t* data, size_t length, uint32_t padding) = 0;
+
+  /**
+   * Broadcasts our advertisement. It only changes when 'generation' does,
+   * so a host may keep the packet it built from it.
+   */
+  virtual void send_advertisement(const std::vector<uint8_t> &advertisement, uint32_t generation) = 0;
+};
+
+struct SmsProtocolConfig {
+  SmsProtocolConfig();
+
+  // Number of full files from which on we advertise a Bloom summary, 0 disables it
+  uint32_t adv_bloom_threshold;
+  // Largest range of chunks a single request may ask for
+  uint16_t max_chunks_per_request;
+  // Seconds between two replies streamed back for a range request
+  double reply_interval;
+  // Number of queued replies from which on further requested chunks are dropped
+  uint32_t max_reply_queue;
+  // Seconds after which a node we stopped hearing from no longer counts as a neighbour
+  double neighbour_expiry;
+  // Bytes of file data per reply. Set it before SetFiles(), all files of a
+  // node are split the same way and only nodes with the same chunk size
+  // exchange chunks.
+  uint16_t chunk_size;
+  // Seconds for which chunks we overheard someone request count as on their
+  // way, we ask for other chunks meanwhile. 0 ignores overheard requests.
+  double overheard_request_timeout;
+  // Ask for random linear combinations of a generation of chunks instead of
+  // the chunks themselves, see sms-rlnc.h. Holders answer both kinds.
+  bool network_coding;
+  // Chunks per generation with network_coding
+  uint16_t generation_size;
+  // The random parts of the advertisement and request delays are stretched
+  // by 1 + load_backoff * SmsProtocolHost::channel_busy(). 0 keeps them
+  // fixed, which did best in tools/sms-contact-sim.
+  double load_backoff;
+  // Every packet we hear pushes our next advertisement back, by at most
+  // this many seconds past the first time it was due. 0 lets a busy
+  // neighbourhood keep us quiet indefinitely, which does best in dense
+  // scenarios: advertisements cut into the transfers around us.
+  double max_advertisement_deferral;
+};
+
+/**
+ * \brief The protocol state machine of one node.
+ *
+ * Every node advertises its full files. A node that hears an advertisement
+ * with files it misses requests chunks of the rarest of them, the holder
+ * streams the chunks back. Packets are handed in through handle_packet()
+ * and timers through on_timer().
+ */
+class SmsProtocol {
+public:
+  SmsProtocol();
+
+  void SetHost(SmsProtocolHost* host);
+  void SetIPAdress(uint32_t address);
+  uint32_t GetIPAddress() const;
+  void SetFiles(const std::vector<FileSMS> &filesToSet);
+
+  SmsProtocolConfig config;
+  FileTable files;
+
+  void start(uint32_t node_id);
+  void stop();
+  void handle_packet(uint32_t sender, const uint8_t* data, size_t length);
+  void on_timer(SmsTimer timer);
+
+  bool add_new_chunk(uint32_t file_id, uint32_t file_size, uint32_t chunk_id, uint32_t sender);
+  void addNodeToSeenList(uint32_t sender);
+  int32_t getFileToRequest(uint32_t node_which_we_ask);
+  void EncodeFilesForAdv(std::vector<uint8_t> &buffer);
+  uint32_t DecodeFilesForAdv(const uint8_t* raw_array, size_t length, uint32_t sender);
+
+  /**
+   * Returns the encoded advertisement of our full files. It is built once
+   * and kept until the set of full files changes, which also bumps
+   * get_advertisement_generation().
+   */
+  const std::vector<uint8_t>& GetAdvertisement();
+  uint32_t get_advertisement_generation() const;
+
+  uint32_t GetNumOfFullFiles() const;
+  uint32_t GetNumOfPartialFiles() const;
+  uint32_t GetNumOfReceivedChunks() const;
+  // Replies with chunks of partial files we already had, or coded replies
+  // that didn't tell us anything new
+  uint32_t GetNumOfDuplicateChunks() const;
+  // Packets and bytes (padding included) sent of each type
+  uint64_t GetNumOfSentPackets(uint8_t packet_type) const;
+  uint64_t GetNumOfSentBytes(uint8_t packet_type) const;
+
+  // We would have to enable C++2011
+  // enum packet_type : uint8_t {adv, req, resp};
+
+  /*
+   * Wire format of requests and replies. Fields are sent one after the
+   * other in this order, without padding and in network byte order, see
+   * serialize(). deserialize() returns false if 'length' is too short.
+   * Advertisements are described in sms-adv-codec.h.
+   */
+
+  typedef struct adv_header {
+    uint8_t packet_type;
+  } adv_header;
+
+  // Type 1, asks the receiver for one chunk
+  typedef struct request_header {
+    uint8_t packet_type;
+    uint32_t receiver_address;
+    uint32_t file_id;
+    uint32_t chunk_id;
+
+    static const size_t serialized_size = 13;
+    void serialize(uint8_t* out) const;
+    bool deserialize(const uint8_t* in, size_t length);
+  } request_header;
+
+  // Type 2, followed by the chunk
+  typedef struct reply_header {
+    uint8_t packet_type;
+    uint32_t original_requester;
+    uint32_t file_id;
+    uint32_t file_size;
+    uint32_t chunk_id;
+    // The chunk size of the sender, which numbered the chunks
+    uint16_t chunk_size;
+
+    static const size_t serialized_size = 19;
+    void serialize(uint8_t* out) const;
+    bool deserialize(const uint8_t* in, size_t length);
+  } reply_header;
+
+  // Type 3, asks for several chunks of one file at once. It is followed by
+  // a bitmap of num_of_chunks bits, bit i is set when chunk first_chunk+i
+  // is wanted.
+  typedef struct range_request_header {
+    uint8_t packet_type;
+    uint32_t receiver_address;
+    uint32_t file_id;
+    uint32_t first_chunk;
+    uint16_t num_of_chunks;
+
+    static const size_t serialized_size = 15;
+    void serialize(uint8_t* out) const;
+    bool deserialize(const uint8_t* in, size_t length);
+  } range_request_header;
+
+  // Type 4, asks for num_of_packets coded packets of a generation, which
+  // holds chunks generation*generation_size and on
+  typedef struct coded_request_header {
+    uint8_t packet_type;
+    uint32_t receiver_address;
+    uint32_t file_id;
+    uint32_t generation;
+    uint16_t generation_size;
+    uint16_t num_of_packets;
+
+    static const size_t serialized_size = 17;
+    void serialize(uint8_t* out) const;
+    bool deserialize(const uint8_t* in, size_t length);
+  } coded_request_header;
+
+  // Type 5, followed by the combination of the chunks of the generation
+  // with the coefficients rlnc_coefficients() draws from 'seed'
+  typedef struct coded_reply_header {
+    uint8_t packet_type;
+    uint32_t original_requester;
+    uint32_t file_id;
+    uint32_t file_size;
+    uint32_t generation;
+    uint32_t seed;
+    uint16_t chunk_size;
+    uint16_t generation_size;
+    // Coded packets of this generation still queued after this one
+    uint16_t remaining;
+
+    static const size_t serialized_size = 27;
+    void serialize(uint8_t* out) const;
+    bool deserialize(const uint8_t* in, size_t length);
+  } coded_reply_header;
+
+private:
+  void cancel_all_events();
+  void transmit(const uint8_t* data, size_t length, uint32_t padding);
+  double get_time_advertisement(bool start);
+  double get_time_request();
+  double get_load_stretch();
+  void Send();
+  void request_packet(uint32_t sender, uint32_t file_id);
+  void queue_reply(uint32_t requester, uint32_t slot, uint32_t chunk_id);
+  void queue_coded_replies(uint32_t requester, uint32_t slot, uint32_t generation, uint16_t num_of_packets);
+  void send_coded_reply(const reply_header &job);
+  void request_generation(uint32_t sender, FileSMSChunks &file, uint32_t first_missing);
+  void gain_chunk(uint32_t slot, uint32_t chunk_id, uint32_t sender);
+  void decode_plain_chunk(uint32_t slot, uint32_t chunk_id, uint32_t sender);
+  void complete_generation(uint32_t slot, uint32_t generation, uint32_t sender);
+  void ServeReplyQueue();
+  void schedule_advertisement();
+  void invalidate_advertisement();
+
+  void handle_advertisement(uint32_t sender, const uint8_t* data, size_t length);
+  void handle_request(uint32_t sender, const uint8_t* data, size_t length);
+  void handle_range_request(uint32_t sender, const uint8_t* data, size_t length);
+  void handle_reply(uint32_t sender, const uint8_t* data, size_t length);
+  void handle_coded_request(uint32_t sender, const uint8_t* data, size_t length);
+  void handle_coded_reply(uint32_t sender, const uint8_t* data, size_t length);
+  void request_next(uint32_t sender);
+  int32_t find_claimable_file(uint32_t file_id, uint32_t holder);
+
+  SmsProtocolHost* m_host;
+  uint32_t address;
+  uint32_t maximum_full_files_seen;
+  uint32_t m_receivedChunks;
+  uint32_t m_duplicateChunks;
+  uint64_t m_sentPackets[SMS_NUM_OF_PACKET_TYPES];
+  uint64_t m_sentBytes[SMS_NUM_OF_PACKET_TYPES];
+
+  /// Cached advertisement, rebuilt when a file becomes full
+  std::vector<uint8_t> m_advertisement;
+  bool m_advertisementValid;
+  uint32_t m_advertisementGeneration;
+  /// When the pending advertisement was first due, -1 if none is
+  double m_advertisementDue;
+
+  /// Binary protocol event trace, see sms-event-trace.h
+  EventTraceBuffer m_eventTrace;
+
+  /// What the pending request timer asks for
+  uint32_t m_requestNode;
+  uint32_t m_requestFileId;
+
+  /// Replies we still have to send, served one every reply_interval. Coded
+  /// ones have packet_type 5 and the generation in chunk_id.
+  std::deque<reply_header> m_replyQueue;
+  /// file_id << 32 | chunk_id of the queued replies, everyone hears a reply
+  /// so a chunk is queued only once for all requesters
+  std::set<uint64_t> m_queuedChunks;
+  /// file_id << 32 | generation to the number of coded replies queued for it
+  std::map<uint64_t, uint32_t> m_queuedGenerations;
+  /// Coefficients of the coded reply being decoded
+  std::vector<uint8_t> m_coefficients;
+  /// The last chunk of the burst we asked for, we ask again once it arrives
+  bool m_burstPending;
+  uint32_t m_burstFileId;
+  uint32_t m_burstLastChunk;
+};
+
+#endif // SMS_PROTOCOL_H
@@ -0,0 +1,92 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-rlnc.h"
+#include "sms-gf256.h"
+#include <cassert>
+#include <cstring>
+
+void rlnc_coefficients(uint32_t seed, uint8_t* coefficients, uint32_t num_of_chunks) {
+  // A hash of (seed, i) per coefficient. Plain xorshift wouldn't do: it is
+  // linear over GF(2), so its coefficient vectors would span too few
+  // dimensions for large generations.
+  bool all_zero = true;
+  for (uint32_t i = 0; i < num_of_chunks; i++) {
+    uint32_t x = seed * 0x9E3779B9 + i * 0x85EBCA6B;
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    coefficients[i] = (uint8_t) (x >> 24);
+    all_zero = all_zero && coefficients[i] == 0;
+  }
+  if (all_zero && num_of_chunks > 0)
+    coefficients[seed % num_of_chunks] = 1;
+}
+
+void rlnc_encode(const uint8_t* const* chunks, uint32_t num_of_chunks, size_t chunk_size,
+                 uint32_t seed, uint8_t* out) {
+  std::vector<uint8_t> coefficients(num_of_chunks);
+  rlnc_coefficients(seed, &coefficients[0], num_of_chunks);
+  memset(out, 0, chunk_size);
+  for (uint32_t i = 0; i < num_of_chunks; i++)
+    gf256_mul_add(out, chunks[i], coefficients[i], chunk_size);
+}
+
+RlncDecoder::RlncDecoder() : m_size(0), m_payload_size(0), m_rank(0) {
+}
+
+RlncDecoder::RlncDecoder(uint32_t num_of_chunks, size_t payload_size)
+  : m_size(num_of_chunks)
+    , m_payload_size(payload_size)
+    , m_rank(0)
+    , m_rows(num_of_chunks * (num_of_chunks + payload_size))
+    , m_has_pivot(num_of_chunks, 0)
+    , m_scratch(num_of_chunks + payload_size)
+{
+}
+
+bool RlncDecoder::add_coded(const uint8_t* coefficients, const uint8_t* payload) {
+  memcpy(&m_scratch[0], coefficients, m_size);
+  if (m_payload_size)
+    memcpy(&m_scratch[m_size], payload, m_payload_size);
+  return insert(&m_scratch[0]);
+}
+
+bool RlncDecoder::add_plain(uint32_t index, const uint8_t* payload) {
+  assert(index < m_size);
+  memset(&m_scratch[0], 0, m_size);
+  m_scratch[index] = 1;
+  if (m_payload_size)
+    memcpy(&m_scratch[m_size], payload, m_payload_size);
+  return insert(&m_scratch[0]);
+}
+
+bool RlncDecoder::insert(uint8_t* row) {
+  size_t width = m_size + m_payload_size;
+  // Cancel the pivots we have
+  for (uint32_t i = 0; i < m_size; i++) {
+    if (row[i] && m_has_pivot[i])
+      gf256_mul_add(row, &m_rows[i * width], row[i], width);
+  }
+  uint32_t pivot = 0;
+  while (pivot < m_size && row[pivot] == 0)
+    pivot++;
+  if (pivot == m_size)
+    return false;
+  gf256_scale(row + pivot, gf256_inv(row[pivot]), width - pivot);
+  // Keep the other rows reduced
+  for (uint32_t i = 0; i < m_size; i++) {
+    uint8_t* other = &m_rows[i * width];
+    if (m_has_pivot[i] && other[pivot])
+      gf256_mul_add(other, row, other[pivot], width);
+  }
+  memcpy(&m_rows[pivot * width], row, width);
+  m_has_pivot[pivot] = 1;
+  m_rank++;
+  return true;
+}
+
+const uint8_t* RlncDecoder::get_chunk(uint32_t index) const {
+  assert(is_complete());
+  return &m_rows[index * (m_size + m_payload_size) + m_size];
+}
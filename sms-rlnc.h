@@ -0,0 +1,92 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_RLNC_H
+#define SMS_RLNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Random linear network coding over GF(2^8). A file is cut into generations
+ * of consecutive chunks, a coded packet is a random linear combination of
+ * the chunks of one generation. Its coefficients are drawn from a 32-bit
+ * seed that travels in the packet instead of the coefficients themselves.
+ * Any generation size linearly independent packets decode the generation,
+ * no matter who they were sent to.
+ */
+
+/**
+ * Fills 'coefficients' with the num_of_chunks coefficients of the packet
+ * with 'seed'. They are never all 0.
+ */
+void rlnc_coefficients(uint32_t seed, uint8_t* coefficients, uint32_t num_of_chunks);
+
+/**
+ * Writes the coded packet with 'seed' of the num_of_chunks chunks of
+ * chunk_size bytes to 'out'.
+ */
+void rlnc_encode(const uint8_t* const* chunks, uint32_t num_of_chunks, size_t chunk_size,
+                 uint32_t seed, uint8_t* out);
+
+/**
+ * \brief Decodes one generation by Gauss-Jordan elimination, one packet at
+ * a time.
+ *
+ * The rows are kept in reduced row echelon form, so once the rank reaches
+ * the generation size the payloads are the chunks. With a payload size of
+ * 0 only the rank is tracked, which is all the simulation needs since chunk
+ * content doesn't matter there.
+ */
+class RlncDecoder {
+public:
+  RlncDecoder();
+  RlncDecoder(uint32_t num_of_chunks, size_t payload_size);
+
+  /**
+   * Adds a coded packet, 'payload' may be 0 with a payload size of 0.
+   * Returns false if it was linearly dependent on the ones we had.
+   */
+  bool add_coded(const uint8_t* coefficients, const uint8_t* payload);
+
+  /**
+   * Adds chunk 'index' of the generation received in the clear.
+   */
+  bool add_plain(uint32_t index, const uint8_t* payload);
+
+  uint32_t size() const;
+  uint32_t rank() const;
+  bool is_complete() const;
+
+  /**
+   * The decoded chunk 'index', only once is_complete().
+   */
+  const uint8_t* get_chunk(uint32_t index) const;
+
+private:
+  bool insert(uint8_t* row);
+
+  uint32_t m_size;
+  size_t m_payload_size;
+  uint32_t m_rank;
+  // m_size rows of m_size coefficients followed by the payload. Row i is
+  // used when m_has_pivot[i], then its first non-zero coefficient is a 1
+  // at column i and no other row has one in that column.
+  std::vector<uint8_t> m_rows;
+  std::vector<uint8_t> m_has_pivot;
+  // Scratch row for add_coded() and add_plain()
+  std::vector<uint8_t> m_scratch;
+};
+
+inline uint32_t RlncDecoder::size() const {
+  return m_size;
+}
+
+inline uint32_t RlncDecoder::rank() const {
+  return m_rank;
+}
+
+inline bool RlncDecoder::is_complete() const {
+  return m_rank == m_size;
+}
+
+#endif // SMS_RLNC_H
@@ -0,0 +1,83 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#include "sms-spatial-grid.h"
+#include <cmath>
+
+// Bigger cells rather than more than this, for huge areas and tiny ranges
+#define GRID_MAX_CELLS (1u << 20)
+
+SpatialGrid::SpatialGrid()
+  : m_min_x(0)
+    , m_min_y(0)
+    , m_cell_size(1)
+    , m_columns(1)
+    , m_rows(1)
+{
+}
+
+void SpatialGrid::set_area(double min_x, double max_x, double min_y, double max_y, double cell_size) {
+  m_min_x = min_x;
+  m_min_y = min_y;
+  m_cell_size = cell_size > 0 ? cell_size : 1;
+  double width = max_x > min_x ? max_x - min_x : 0;
+  double height = max_y > min_y ? max_y - min_y : 0;
+  while ((std::floor(width / m_cell_size) + 1) * (std::floor(height / m_cell_size) + 1) > GRID_MAX_CELLS)
+    m_cell_size *= 2;
+  m_columns = (uint32_t) std::floor(width / m_cell_size) + 1;
+  m_rows = (uint32_t) std::floor(height / m_cell_size) + 1;
+  m_cells.assign(m_columns * m_rows + 1, 0);
+  m_ids.clear();
+  m_x.clear();
+  m_y.clear();
+}
+
+uint32_t SpatialGrid::get_column(double x) const {
+  double column = std::floor((x - m_min_x) / m_cell_size);
+  if (!(column > 0))
+    return 0;
+  return column < m_columns ? (uint32_t) column : m_columns - 1;
+}
+
+uint32_t SpatialGrid::get_row(double y) const {
+  double row = std::floor((y - m_min_y) / m_cell_size);
+  if (!(row > 0))
+    return 0;
+  return row < m_rows ? (uint32_t) row : m_rows - 1;
+}
+
+void SpatialGrid::build(const std::vector<double> &x, const std::vector<double> &y) {
+  // Counting sort by cell
+  std::vector<uint32_t> cell(x.size());
+  m_cells.assign(m_columns * m_rows + 1, 0);
+  for (uint32_t i = 0; i < x.size(); i++) {
+    cell[i] = get_row(y[i]) * m_columns + get_column(x[i]);
+    m_cells[cell[i] + 1]++;
+  }
+  for (uint32_t c = 0; c < m_columns * m_rows; c++)
+    m_cells[c + 1] += m_cells[c];
+  m_ids.resize(x.size());
+  m_x.resize(x.size());
+  m_y.resize(x.size());
+  std::vector<uint32_t> next(m_cells.begin(), m_cells.end() - 1);
+  for (uint32_t i = 0; i < x.size(); i++) {
+    uint32_t slot = next[cell[i]]++;
+    m_ids[slot] = i;
+    m_x[slot] = x[i];
+    m_y[slot] = y[i];
+  }
+}
+
+void SpatialGrid::find(double x, double y, double radius, std::vector<uint32_t> &ids) const {
+  uint32_t first_column = get_column(x - radius), last_column = get_column(x + radius);
+  uint32_t first_row = get_row(y - radius), last_row = get_row(y + radius);
+  double radius2 = radius * radius;
+  for (uint32_t row = first_row; row <= last_row; row++) {
+    for (uint32_t c = row * m_columns + first_column; c <= row * m_columns + last_column; c++) {
+      for (uint32_t slot = m_cells[c]; slot < m_cells[c + 1]; slot++) {
+        double dx = m_x[slot] - x;
+        double dy = m_y[slot] - y;
+        if (dx*dx + dy*dy <= radius2)
+          ids.push_back(m_ids[slot]);
+      }
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef SMS_SPATIAL_GRID_H
+#define SMS_SPATIAL_GRID_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \brief Uniform grid of points, to find the nodes near a sender without
+ * looking at all of them.
+ *
+ * build() buckets a snapshot of the positions into square cells, points
+ * are numbered by their index. find() returns every point whose position
+ * in the snapshot is within 'radius', so for nodes that moved at most 'm'
+ * metres since the snapshot, a radius of range + m finds every node within
+ * the range and the caller checks their current positions. Points outside
+ * the area go into the nearest cell and are still found.
+ */
+class SpatialGrid {
+public:
+  SpatialGrid();
+
+  /**
+   * Covers the area with cells of at least 'cell_size' metres, before
+   * build().
+   */
+  void set_area(double min_x, double max_x, double min_y, double max_y, double cell_size);
+
+  void build(const std::vector<double> &x, const std::vector<double> &y);
+
+  /**
+   * Appends the points within 'radius' of (x, y) in the snapshot to 'ids',
+   * in no particular order.
+   */
+  void find(double x, double y, double radius, std::vector<uint32_t> &ids) const;
+
+  uint32_t get_num_of_cells() const;
+
+private:
+  uint32_t get_column(double x) const;
+  uint32_t get_row(double y) const;
+
+  double m_min_x, m_min_y;
+  double m_cell_size;
+  uint32_t m_columns, m_rows;
+  // Points of cell c are m_ids[m_cells[c]] to m_ids[m_cells[c + 1] - 1],
+  // with their positions next to them
+  std::vector<uint32_t> m_cells;
+  std::vector<uint32_t> m_ids;
+  std::vector<double> m_x, m_y;
+};
+
+inline uint32_t SpatialGrid::get_num_of_cells() const {
+  return m_columns * m_rows;
+}
+
+#endif // SMS_SPATIAL_GRID_H
@@ -0,0 +1,958 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Runs the protocol of sms-protocol.h on a contact graph instead of the
+ * ns-3 wifi stack, for quick parameter studies with many nodes.
+ *
+ * Nodes walk like RandomWalk2dMobilityModel does in sms-main (a new
+ * direction and a speed of 2 to 4 m/s after every metre, reflecting at the
+ * edges of the area). A broadcast reaches every node within --range metres
+ * when it starts, and each copy is lost with probability --loss. They are
+ * looked up in a grid of the node positions, which finds the same receivers
+ * as checking every node (--spatialIndex=0). The radio is modelled
+ * crudely: a frame takes its 24 Mbps airtime, a node defers while it hears
+ * a frame, can't receive while it sends, and two frames that overlap at a
+ * receiver are both lost. Every node draws its timers and its walk from its
+ * own random streams and measures the channel load from the frames it sends
+ * and hears.
+ *
+ * Usage: sms-contact-sim [--RngRun=1] [--nodes=25] [--files=100]
+ *                        [--maxFilesPerNode=10] [--zipfExponent=1.1]
+ *                        [--duration=100]
+ *                        [--minX=-50] [--maxX=50] [--minY=-50] [--maxY=50]
+ *                        [--randomPlacement=0] [--range=25] [--loss=0]
+ *                        [--spatialIndex=1]
+ *                        [--chunkSize=1450] [--overheardRequestTimeout=0.1]
+ *                        [--coding=0] [--generationSize=32]
+ *                        [--loadBackoff=0] [--maxAdvertisementDeferral=0]
+ *                        [--outputDir=.] [--eventTrace=<file>]
+ *                        [--metricsInterval=1]
+ *                        [--stopOnConvergence=1] [--stallWindow=0]
+ *                        [--pcap=none|capture|ring] [--pcapNodes=0-9,20]
+ *                        [--pcapTypes=request,reply] [--pcapStart=0]
+ *                        [--pcapStop=0] [--pcapSnapLength=0]
+ *                        [--pcapRing=1000] [--pcapTrigger=Truncated|...]
+ *                        [--pcapCompress=0]
+ *                        [--logLevel=0|1|2]
+ *
+ * It writes summary.csv and nodes.csv like sms-main, so tools/sms-sweep can
+ * run it with --bin=tools/sms-contact-sim.
+ */
+#include "../sms-protocol.h"
+#include "../sms-log.h"
+#include "../sms-channel-load.h"
+#include "../sms-lazy-timer.h"
+#include "../sms-metrics.h"
+#include "../sms-capture.h"
+#include "../sms-convergence.h"
+#include "../sms-spatial-grid.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <time.h>
+
+// 10.1.1.1, the first address sms-main assigns
+#define FIRST_ADDRESS 0x0A010101u
+// Applications start two seconds in, like in sms-main
+#define START_TIME 2.0
+
+// 802.11a at 24 Mbps, plus what the UDP, IP, LLC and MAC headers add
+#define BIT_RATE 24e6
+#define PREAMBLE 20e-6
+#define HEADER_BYTES 64
+#define DIFS 34e-6
+#define SLOT 9e-6
+#define CONTENTION_WINDOW 15
+
+// Speeds of the random walk, m/s
+#define WALK_MIN_SPEED 2.0
+#define WALK_MAX_SPEED 4.0
+
+/**
+ * \brief xorshift64*, so that runs don't depend on the C library.
+ */
+class SimRandom {
+public:
+  explicit SimRandom(uint64_t seed) : m_state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+  uint64_t next() {
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+    return m_state * 2685821657736338717ull;
+  }
+
+  // Uniform in [0, 1)
+  double uniform() {
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  double uniform(double min, double max) {
+    return min + (max - min) * uniform();
+  }
+
+  // Uniform in [min, max]
+  uint32_t integer(uint32_t min, uint32_t max) {
+    return min + (uint32_t) (uniform() * (max - min + 1));
+  }
+
+private:
+  uint64_t m_state;
+};
+
+struct SimScenario {
+  SimScenario();
+
+  uint32_t run;
+  uint32_t num_of_nodes;
+  uint32_t total_file_count;
+  uint32_t max_file_count_per_node;
+  double zipf_exponent;
+  double duration;
+  double min_x, max_x, min_y, max_y;
+  bool random_placement;
+  double range;
+  double loss;
+  bool spatial_index;
+  uint16_t chunk_size;
+  double overheard_request_timeout;
+  bool coding;
+  uint16_t generation_size;
+  double load_backoff;
+  double max_advertisement_deferral;
+  double metrics_interval;
+  bool stop_on_convergence;
+  double stall_window;
+  // Like in sms-main, see the README
+  std::string pcap;
+  std::string pcap_nodes;
+  std::string pcap_types;
+  double pcap_start;
+  double pcap_stop;
+  uint32_t pcap_snap_length;
+  uint32_t pcap_ring;
+  std::string pcap_trigger;
+  bool pcap_compress;
+  std::string output_dir;
+  std::string event_trace;
+  int log_level;
+};
+
+SimScenario::SimScenario()
+  : run(1)
+    , num_of_nodes(25)
+    , total_file_count(100)
+    , max_file_count_per_node(10)
+    , zipf_exponent(1.1)
+    , duration(100)
+    , min_x(-50), max_x(50), min_y(-50), max_y(50)
+    , random_placement(false)
+    , range(25)
+    , loss(0)
+    , spatial_index(true)
+    , chunk_size(DEFAULT_CHUNK_SIZE)
+    , overheard_request_timeout(SmsProtocolConfig().overheard_request_timeout)
+    , coding(false)
+    , generation_size(SmsProtocolConfig().generation_size)
+    , load_backoff(SmsProtocolConfig().load_backoff)
+    , max_advertisement_deferral(SmsProtocolConfig().max_advertisement_deferral)
+    , metrics_interval(1.0)
+    , stop_on_convergence(true)
+    , stall_window(0)
+    , pcap("none")
+    , pcap_start(0)
+    , pcap_stop(0)
+    , pcap_snap_length(0)
+    , pcap_ring(1000)
+    , pcap_trigger(SMS_CAPTURE_TRIGGERS)
+    , pcap_compress(false)
+    , output_dir(".")
+    , log_level(SMS_LEVEL_NONE)
+{
+}
+
+enum SimEventKind {
+  SIM_EVENT_TIMER = 0,
+  SIM_EVENT_RECEIVE
+};
+
+struct SimEvent {
+  double time;
+  // Keeps events at the same time in the order they were scheduled
+  uint64_t seq;
+  uint8_t kind;
+  uint32_t node;
+  // The timer, or the index of the delivery
+  uint32_t arg;
+  uint32_t generation;
+
+  // Inverted, std::priority_queue pops the largest element
+  bool operator<(const SimEvent &other) const {
+    if (time != other.time)
+      return time > other.time;
+    return seq > other.seq;
+  }
+};
+
+struct SimFrame {
+  std::vector<uint8_t> data;
+  uint32_t padding;
+  uint32_t sender;
+  uint32_t num_of_deliveries;
+};
+
+struct SimDelivery {
+  uint32_t frame;
+  uint32_t receiver;
+  double start;
+  double end;
+  bool lost;
+};
+
+class ContactSim;
+
+/**
+ * \brief One node, the host of its SmsProtocol.
+ */
+class SimNode : public SmsProtocolHost {
+public:
+  SimNode();
+
+  virtual double now() const;
+  virtual double random();
+  virtual double channel_busy();
+  virtual void schedule(SmsTimer timer, double delay);
+  virtual void cancel(SmsTimer timer);
+  virtual bool is_pending(SmsTimer timer) const;
+  virtual void send(const uint8_t* data, size_t length, uint32_t padding);
+  virtual void send_advertisement(const std::vector<uint8_t> &advertisement, uint32_t generation);
+
+  ContactSim* sim;
+  uint32_t id;
+  SmsProtocol protocol;
+  // The protocol's random numbers, independent of the other nodes'
+  SimRandom rng;
+  ChannelLoad channel_load;
+
+  LazyTimer timers[SMS_NUM_OF_TIMERS];
+  // Bumped when a timer event is replaced by an earlier one, the replaced
+  // one stays queued and is dropped when it comes up
+  uint32_t timer_generation[SMS_NUM_OF_TIMERS];
+
+  // Position at walk_start, walking at (vx, vy) until walk_end. The walk
+  // has its own random stream, so it doesn't matter when it is looked at.
+  double x, y, vx, vy;
+  double walk_start, walk_end;
+  SimRandom walk_rng;
+
+  // Until when the node hears a frame or sends one itself
+  double busy_until;
+  double tx_end;
+  // The last delivery to this node, to detect collisions
+  int32_t last_delivery;
+
+  std::vector<FileSMS> initial_files;
+  uint32_t full_files;
+};
+
+class ContactSim {
+public:
+  ContactSim(const SimScenario &scenario);
+
+  void setup();
+  // Opens metrics.csv and file-completion.csv unless --metricsInterval=0
+  bool open_metrics();
+  // Opens the capture file for --pcap=capture or ring
+  bool open_capture();
+  void run();
+  bool write_results();
+
+  double now() const { return m_now; }
+
+  void schedule_timer(SimNode &node, SmsTimer timer, double delay);
+  // Timer events pushed per simulated second, the comparison with sms-main
+  double timer_events_per_second() const;
+  void broadcast(SimNode &sender, const uint8_t* data, size_t length, uint32_t padding);
+  void on_warning(const std::string &message);
+
+private:
+  // Walks on up to 'time', which must not decrease
+  void update_walk(SimNode &node, double time);
+  void new_walk(SimNode &node);
+  // Where the node is at 'time', at or after its last update_walk()
+  void get_position(const SimNode &node, double time, double &x, double &y) const;
+  // Buckets the nodes at m_now
+  void build_grid();
+  // Appends the nodes other than the sender within range of (x, y) at
+  // 'time' to m_receivers, in order of their ids
+  void find_receivers(uint32_t sender, double x, double y, double time);
+  void push(double time, SimEventKind kind, uint32_t node, uint32_t arg, uint32_t generation);
+  void receive(SimDelivery &delivery);
+  void update_counters(SimNode &node);
+  // Returns whether to stop at 'now'
+  bool check_convergence(double now);
+  void capture(uint32_t node, SmsCapture::Direction direction, double time, const SimFrame &frame);
+  std::vector<FileSMS> initial_file_list();
+
+  SimScenario m_scenario;
+  SimRandom m_rng;
+  SmsMetrics m_metrics;
+  SmsConvergence m_convergence;
+  SmsCapture m_capture;
+  // The frame being captured, with the headers ns-3 would put on the air
+  std::vector<uint8_t> m_capture_frame;
+  double m_now;
+  // Events pushed so far, also breaks ties between events at the same time
+  uint64_t m_seq;
+  uint64_t m_num_of_events;
+  uint64_t m_num_of_timer_events;
+  std::priority_queue<SimEvent> m_events;
+  std::vector<SimNode> m_nodes;
+
+  std::vector<double> m_zipf_cdf;
+
+  SpatialGrid m_grid;
+  // When the grid was built, -1 before
+  double m_grid_time;
+  // Nodes may have moved this far since, before it is built again
+  double m_grid_margin;
+  std::vector<double> m_grid_x, m_grid_y;
+  std::vector<uint32_t> m_receivers;
+
+  // Frames and deliveries in flight, recycled through the free lists
+  std::vector<SimFrame> m_frames;
+  std::vector<uint32_t> m_free_frames;
+  std::vector<SimDelivery> m_deliveries;
+  std::vector<uint32_t> m_free_deliveries;
+
+  double m_last_completion_time;
+  // -1 until the run converged
+  double m_convergence_time;
+  uint64_t m_num_of_frames;
+  uint64_t m_num_of_received;
+  uint64_t m_num_of_lost;
+};
+
+SimNode::SimNode()
+  : sim(0), id(0), rng(0), x(0), y(0), vx(0), vy(0), walk_start(0), walk_end(0), walk_rng(0),
+    busy_until(0), tx_end(0), last_delivery(-1), full_files(0)
+{
+  for (int i = 0; i < SMS_NUM_OF_TIMERS; i++) {
+    timer_generation[i] = 0;
+  }
+}
+
+double SimNode::now() const {
+  return sim->now();
+}
+
+double SimNode::random() {
+  return rng.uniform();
+}
+
+double SimNode::channel_busy() {
+  return channel_load.get_busy(sim->now());
+}
+
+void SimNode::schedule(SmsTimer timer, double delay) {
+  sim->schedule_timer(*this, timer, delay);
+}
+
+void SimNode::cancel(SmsTimer timer) {
+  timers[timer].clear();
+}
+
+bool SimNode::is_pending(SmsTimer timer) const {
+  return timers[timer].is_set();
+}
+
+void SimNode::send(const uint8_t* data, size_t length, uint32_t padding) {
+  sim->broadcast(*this, data, length, padding);
+}
+
+void SimNode::send_advertisement(const std::vector<uint8_t> &advertisement, uint32_t) {
+  sim->broadcast(*this, &advertisement[0], advertisement.size(), 0);
+}
+
+ContactSim::ContactSim(const SimScenario &scenario)
+  : m_scenario(scenario)
+    , m_rng(scenario.run)
+    , m_now(0)
+    , m_seq(0)
+    , m_num_of_events(0)
+    , m_num_of_timer_events(0)
+    , m_grid_time(-1)
+    , m_grid_margin(scenario.range / 2)
+    , m_last_completion_time(-1)
+    , m_convergence_time(-1)
+    , m_num_of_frames(0)
+    , m_num_of_received(0)
+    , m_num_of_lost(0)
+{
+}
+
+void ContactSim::push(double time, SimEventKind kind, uint32_t node, uint32_t arg, uint32_t generation) {
+  SimEvent event = {time, m_seq++, (uint8_t) kind, node, arg, generation};
+  m_events.push(event);
+}
+
+void ContactSim::schedule_timer(SimNode &node, SmsTimer timer, double delay) {
+  if (node.timers[timer].set(m_now + delay)) {
+    node.timer_generation[timer]++;
+    push(m_now + delay, SIM_EVENT_TIMER, node.id, timer, node.timer_generation[timer]);
+    m_num_of_timer_events++;
+  }
+}
+
+double ContactSim::timer_events_per_second() const {
+  return m_now > START_TIME ? m_num_of_timer_events / (m_now - START_TIME) : 0;
+}
+
+// Mirrors a coordinate that left [min, max] back into it
+static double reflect(double v, double min, double max) {
+  double width = max - min;
+  if (width <= 0)
+    return min;
+  double t = std::fmod(v - min, 2*width);
+  if (t < 0)
+    t += 2*width;
+  return t <= width ? min + t : max - (t - width);
+}
+
+void ContactSim::new_walk(SimNode &node) {
+  double direction = node.walk_rng.uniform(0, 2*M_PI);
+  double speed = node.walk_rng.uniform(WALK_MIN_SPEED, WALK_MAX_SPEED);
+  node.vx = speed * std::cos(direction);
+  node.vy = speed * std::sin(direction);
+  // One metre per walk
+  node.walk_end = node.walk_start + 1.0/speed;
+}
+
+void ContactSim::update_walk(SimNode &node, double time) {
+  while (node.walk_end <= time) {
+    get_position(node, node.walk_end, node.x, node.y);
+    node.walk_start = node.walk_end;
+    new_walk(node);
+  }
+}
+
+void ContactSim::get_position(const SimNode &node, double time, double &x, double &y) const {
+  double dt = time - node.walk_start;
+  x = reflect(node.x + node.vx*dt, m_scenario.min_x, m_scenario.max_x);
+  y = reflect(node.y + node.vy*dt, m_scenario.min_y, m_scenario.max_y);
+}
+
+void ContactSim::build_grid() {
+  m_grid_x.resize(m_nodes.size());
+  m_grid_y.resize(m_nodes.size());
+  for (uint32_t i = 0; i < m_nodes.size(); i++) {
+    update_walk(m_nodes[i], m_now);
+    get_position(m_nodes[i], m_now, m_grid_x[i], m_grid_y[i]);
+  }
+  m_grid.build(m_grid_x, m_grid_y);
+  m_grid_time = m_now;
+}
+
+void ContactSim::find_receivers(uint32_t sender, double x, double y, double time) {
+  double range2 = m_scenario.range * m_scenario.range;
+  if (!m_scenario.spatial_index) {
+    for (uint32_t i = 0; i < m_nodes.size(); i++)
+      m_receivers.push_back(i);
+  } else {
+    if (m_grid_time < 0 || (m_now - m_grid_time) * WALK_MAX_SPEED > m_grid_margin)
+      build_grid();
+    // Nobody walked further than this since the grid was built, plus a
+    // little for rounding
+    double moved = (time - m_grid_time) * WALK_MAX_SPEED + 1e-6;
+    m_grid.find(x, y, m_scenario.range + moved, m_receivers);
+    // The order of the exhaustive loop, it decides the order of the random
+    // numbers and events
+    std::sort(m_receivers.begin(), m_receivers.end());
+  }
+  size_t num_of_receivers = 0;
+  for (size_t i = 0; i < m_receivers.size(); i++) {
+    SimNode &receiver = m_nodes[m_receivers[i]];
+    if (receiver.id == sender)
+      continue;
+    update_walk(receiver, m_now);
+    double rx, ry;
+    get_position(receiver, time, rx, ry);
+    double dx = rx - x;
+    double dy = ry - y;
+    if (dx*dx + dy*dy <= range2)
+      m_receivers[num_of_receivers++] = receiver.id;
+  }
+  m_receivers.resize(num_of_receivers);
+}
+
+// Same draw as getInitialFileList: 1 to maxFilesPerNode distinct files with
+// Zipf(--zipfExponent) popularity, 1000 KB each
+std::vector<FileSMS> ContactSim::initial_file_list() {
+  std::vector<FileSMS> files;
+  uint32_t num_of_files = m_rng.integer(1, m_scenario.max_file_count_per_node);
+  if (num_of_files > m_scenario.total_file_count)
+    num_of_files = m_scenario.total_file_count;
+  std::set<uint32_t> ids;
+  while (files.size() < num_of_files) {
+    double u = m_rng.uniform() * m_zipf_cdf.back();
+    uint32_t id = std::lower_bound(m_zipf_cdf.begin(), m_zipf_cdf.end(), u) - m_zipf_cdf.begin() + 1;
+    if (ids.insert(id).second)
+      files.push_back(FileSMS(id, 1000));
+  }
+  return files;
+}
+
+void ContactSim::setup() {
+  double sum = 0;
+  m_zipf_cdf.resize(m_scenario.total_file_count);
+  for (uint32_t i = 0; i < m_scenario.total_file_count; i++) {
+    sum += 1.0 / std::pow(i + 1.0, m_scenario.zipf_exponent);
+    m_zipf_cdf[i] = sum;
+  }
+
+  m_nodes.resize(m_scenario.num_of_nodes);
+  for (uint32_t i = 0; i < m_nodes.size(); i++) {
+    SimNode &node = m_nodes[i];
+    node.sim = this;
+    node.id = i;
+    node.rng = SimRandom(((uint64_t) m_scenario.run << 32) | i);
+    node.walk_rng = SimRandom(((uint64_t) m_scenario.run << 32) | i | 0x80000000u);
+    if (m_scenario.random_placement) {
+      node.x = m_rng.uniform(m_scenario.min_x, m_scenario.max_x);
+      node.y = m_rng.uniform(m_scenario.min_y, m_scenario.max_y);
+    } else {
+      // The grid of installMobility
+      node.x = 5.0 * (i % 5);
+      node.y = 10.0 * (i / 5);
+    }
+    new_walk(node);
+  }
+  for (uint32_t i = 0; i < m_nodes.size(); i++) {
+    SimNode &node = m_nodes[i];
+    node.initial_files = initial_file_list();
+    node.protocol.SetHost(&node);
+    node.protocol.SetIPAdress(FIRST_ADDRESS + i);
+    node.protocol.config.chunk_size = m_scenario.chunk_size;
+    node.protocol.config.overheard_request_timeout = m_scenario.overheard_request_timeout;
+    node.protocol.config.network_coding = m_scenario.coding;
+    node.protocol.config.generation_size = m_scenario.generation_size;
+    node.protocol.config.load_backoff = m_scenario.load_backoff;
+    node.protocol.config.max_advertisement_deferral = m_scenario.max_advertisement_deferral;
+    node.protocol.SetFiles(node.initial_files);
+    node.full_files = node.protocol.GetNumOfFullFiles();
+    m_convergence.add_node(&node.protocol);
+  }
+  m_convergence.set_stall_window(m_scenario.stall_window);
+  // The receivers of a frame are at most a cell away from the sender's cell
+  m_grid.set_area(m_scenario.min_x, m_scenario.max_x, m_scenario.min_y, m_scenario.max_y,
+                  m_scenario.range + m_grid_margin);
+}
+
+void ContactSim::broadcast(SimNode &sender, const uint8_t* data, size_t length, uint32_t padding) {
+  double airtime = PREAMBLE + (length + padding + HEADER_BYTES) * 8 / BIT_RATE;
+  double start = std::max(m_now, std::max(sender.busy_until, sender.tx_end));
+  start += DIFS + SLOT * m_rng.integer(0, CONTENTION_WINDOW);
+  double end = start + airtime;
+  sender.tx_end = end;
+  sender.channel_load.add_busy(start, airtime);
+  m_num_of_frames++;
+
+  uint32_t frame_index;
+  if (m_free_frames.empty()) {
+    frame_index = m_frames.size();
+    m_frames.push_back(SimFrame());
+  } else {
+    frame_index = m_free_frames.back();
+    m_free_frames.pop_back();
+  }
+  SimFrame &frame = m_frames[frame_index];
+  frame.data.assign(data, data + length);
+  frame.padding = padding;
+  frame.sender = sender.id;
+  frame.num_of_deliveries = 0;
+  capture(sender.id, SmsCapture::CAPTURE_OUTBOUND, start, frame);
+
+  // Walks are only updated up to now, the frame starts a few slots later
+  update_walk(sender, m_now);
+  double x, y;
+  get_position(sender, start, x, y);
+  m_receivers.clear();
+  find_receivers(sender.id, x, y, start);
+  for (size_t r = 0; r < m_receivers.size(); r++) {
+    uint32_t i = m_receivers[r];
+    SimNode &receiver = m_nodes[i];
+    receiver.busy_until = std::max(receiver.busy_until, end);
+    receiver.channel_load.add_busy(start, airtime);
+
+    uint32_t delivery_index;
+    if (m_free_deliveries.empty()) {
+      delivery_index = m_deliveries.size();
+      m_deliveries.push_back(SimDelivery());
+    } else {
+      delivery_index = m_free_deliveries.back();
+      m_free_deliveries.pop_back();
+    }
+    SimDelivery &delivery = m_deliveries[delivery_index];
+    delivery.frame = frame_index;
+    delivery.receiver = i;
+    delivery.start = start;
+    delivery.end = end;
+    delivery.lost = m_rng.uniform() < m_scenario.loss;
+    // Half duplex
+    if (receiver.tx_end > start)
+      delivery.lost = true;
+    if (receiver.last_delivery != -1) {
+      SimDelivery &previous = m_deliveries[receiver.last_delivery];
+      if (previous.receiver == i && previous.end > start && previous.start < end) {
+        previous.lost = true;
+        delivery.lost = true;
+      }
+    }
+    receiver.last_delivery = delivery_index;
+    frame.num_of_deliveries++;
+    push(end, SIM_EVENT_RECEIVE, i, delivery_index, 0);
+  }
+  if (frame.num_of_deliveries == 0)
+    m_free_frames.push_back(frame_index);
+}
+
+void ContactSim::update_counters(SimNode &node) {
+  uint32_t full_files = node.protocol.GetNumOfFullFiles();
+  if (full_files > node.full_files)
+    m_last_completion_time = m_now;
+  node.full_files = full_files;
+}
+
+void ContactSim::receive(SimDelivery &delivery) {
+  SimNode &receiver = m_nodes[delivery.receiver];
+  SimFrame &frame = m_frames[delivery.frame];
+  if (delivery.lost) {
+    m_num_of_lost++;
+  } else {
+    m_num_of_received++;
+    capture(delivery.receiver, SmsCapture::CAPTURE_INBOUND, delivery.end, frame);
+    receiver.protocol.handle_packet(FIRST_ADDRESS + frame.sender, &frame.data[0], frame.data.size());
+    update_counters(receiver);
+  }
+  if (--frame.num_of_deliveries == 0)
+    m_free_frames.push_back(delivery.frame);
+}
+
+bool ContactSim::open_metrics() {
+  if (m_scenario.metrics_interval <= 0)
+    return true;
+  if (!m_metrics.open(m_scenario.output_dir + "/"))
+    return false;
+  for (uint32_t i = 0; i < m_nodes.size(); i++)
+    m_metrics.add_node(&m_nodes[i].protocol);
+  return true;
+}
+
+// The log watcher is a plain function, it hands warnings to the simulation
+static ContactSim* capturing_sim = 0;
+
+static void capture_warning(SmsLogLevel, const std::string &message) {
+  capturing_sim->on_warning(message);
+}
+
+bool ContactSim::open_capture() {
+  if (m_scenario.pcap == "none")
+    return true;
+  if ((m_scenario.pcap != "capture" && m_scenario.pcap != "ring") || !m_capture.set_nodes(m_scenario.pcap_nodes) ||
+      !m_capture.set_types(m_scenario.pcap_types)) {
+    fprintf(stderr, "Invalid --pcap, --pcapNodes or --pcapTypes\n");
+    return false;
+  }
+  m_capture.set_window(m_scenario.pcap_start, m_scenario.pcap_stop);
+  m_capture.set_snap_length(m_scenario.pcap_snap_length);
+  if (m_scenario.pcap == "ring") {
+    m_capture.set_ring(m_scenario.pcap_ring);
+    m_capture.set_triggers(m_scenario.pcap_trigger);
+    capturing_sim = this;
+    sms_log_set_watcher(&capture_warning, SMS_LEVEL_WARN);
+  }
+  std::string path = m_scenario.output_dir + "/sms16.pcapng" + (m_scenario.pcap_compress ? ".gz" : "");
+  if (!m_capture.open(path, m_scenario.pcap_compress)) {
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void ContactSim::on_warning(const std::string &message) {
+  m_capture.on_warning((uint64_t) (m_now * 1e9 + 0.5), message);
+}
+
+static void put_u16(uint8_t* out, uint16_t value) {
+  out[0] = value >> 8;
+  out[1] = (uint8_t) value;
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+  put_u16(out, value >> 16);
+  put_u16(out + 2, (uint16_t) value);
+}
+
+void ContactSim::capture(uint32_t node, SmsCapture::Direction direction, double time, const SimFrame &frame) {
+  uint64_t time_ns = (uint64_t) (time * 1e9 + 0.5);
+  if (!m_capture.is_wanted(node, time_ns))
+    return;
+  // An adhoc data frame to the broadcast address from the MAC address ns-3
+  // gives the sender, LLC/SNAP, IPv4 and UDP to port 42, then the packet,
+  // its padding and the FCS ns-3 leaves 0
+  const uint32_t headers = 24 + 8 + 20 + 8;
+  uint32_t ip_length = 20 + 8 + frame.data.size() + frame.padding;
+  m_capture_frame.assign(headers + frame.data.size() + frame.padding + 4, 0);
+  uint8_t* mac = &m_capture_frame[0];
+  mac[0] = 0x08;
+  memset(mac + 4, 0xFF, 6);
+  put_u32(mac + 12, frame.sender + 1);
+  uint8_t* llc = mac + 24;
+  llc[0] = 0xAA;
+  llc[1] = 0xAA;
+  llc[2] = 0x03;
+  llc[6] = 0x08;
+  uint8_t* ip = llc + 8;
+  ip[0] = 0x45;
+  put_u16(ip + 2, (uint16_t) ip_length);
+  ip[8] = 64;
+  ip[9] = 17;
+  put_u32(ip + 12, FIRST_ADDRESS + frame.sender);
+  put_u32(ip + 16, 0xFFFFFFFFu);
+  uint8_t* udp = ip + 20;
+  put_u16(udp, 49153);
+  put_u16(udp + 2, 42);
+  put_u16(udp + 4, (uint16_t) (ip_length - 20));
+  if (!frame.data.empty())
+    memcpy(udp + 8, &frame.data[0], frame.data.size());
+  m_capture.add_frame(node, direction, time_ns, &m_capture_frame[0], m_capture_frame.size());
+}
+
+bool ContactSim::check_convergence(double now) {
+  if (m_convergence_time >= 0)
+    return false;
+  SmsConvergence::State state = m_convergence.check(now);
+  if (state == SmsConvergence::CONVERGENCE_RUNNING)
+    return false;
+  if (state == SmsConvergence::CONVERGENCE_STALLED) {
+    fprintf(stderr, "No chunk gained since %g s, stopping at %g s\n", m_convergence.get_last_progress(), now);
+    return true;
+  }
+  m_convergence_time = m_last_completion_time >= 0 ? m_last_completion_time : now;
+  fprintf(stderr, "Converged at %g s, noticed at %g s\n", m_convergence_time, now);
+  return m_scenario.stop_on_convergence;
+}
+
+void ContactSim::run() {
+  double wall_start = (double) clock() / CLOCKS_PER_SEC;
+  m_now = START_TIME;
+  for (uint32_t i = 0; i < m_nodes.size(); i++)
+    m_nodes[i].protocol.start(i);
+
+  // Samples and convergence checks are taken between events, not queued,
+  // so they don't change the order of the others
+  double next_sample = START_TIME;
+  double next_check = START_TIME;
+  bool stop = false;
+  while (!m_events.empty() && m_events.top().time <= m_scenario.duration) {
+    for (; !stop && next_check <= m_events.top().time; next_check += CONVERGENCE_CHECK_INTERVAL)
+      stop = check_convergence(next_check);
+    if (stop) {
+      m_now = next_check - CONVERGENCE_CHECK_INTERVAL;
+      break;
+    }
+    for (; m_metrics.is_open() && next_sample <= m_events.top().time; next_sample += m_scenario.metrics_interval)
+      m_metrics.sample(next_sample);
+    SimEvent event = m_events.top();
+    m_events.pop();
+    m_now = event.time;
+    SimNode &node = m_nodes[event.node];
+    if (event.kind == SIM_EVENT_TIMER) {
+      if (event.generation != node.timer_generation[event.arg])
+        continue;
+      LazyTimer &timer = node.timers[event.arg];
+      LazyTimer::Action action = timer.fire(m_now);
+      if (action == LazyTimer::LAZY_TIMER_REARM) {
+        push(timer.get_deadline(), SIM_EVENT_TIMER, node.id, event.arg, node.timer_generation[event.arg]);
+        m_num_of_timer_events++;
+      }
+      if (action != LazyTimer::LAZY_TIMER_EXPIRE)
+        continue;
+      m_num_of_events++;
+      node.protocol.on_timer((SmsTimer) event.arg);
+      update_counters(node);
+    } else {
+      m_num_of_events++;
+      uint32_t delivery_index = event.arg;
+      receive(m_deliveries[delivery_index]);
+      if (node.last_delivery == (int32_t) delivery_index)
+        node.last_delivery = -1;
+      m_free_deliveries.push_back(delivery_index);
+    }
+  }
+  if (!stop)
+    m_now = m_scenario.duration;
+  for (; m_metrics.is_open() && next_sample < m_now; next_sample += m_scenario.metrics_interval)
+    m_metrics.sample(next_sample);
+  m_metrics.sample(m_now);
+  m_metrics.close();
+  if (m_capture.is_open())
+    fprintf(stderr, "%llu frames captured, %u ring dumps\n", (unsigned long long) m_capture.get_num_of_frames(),
+            m_capture.get_num_of_dumps());
+  m_capture.close();
+  for (uint32_t i = 0; i < m_nodes.size(); i++)
+    m_nodes[i].protocol.stop();
+
+  double wall = (double) clock() / CLOCKS_PER_SEC - wall_start;
+  fprintf(stderr, "%llu events, %llu frames, %llu received, %llu lost in %.2f s (%.0f events/s)\n",
+          (unsigned long long) m_num_of_events, (unsigned long long) m_num_of_frames,
+          (unsigned long long) m_num_of_received, (unsigned long long) m_num_of_lost,
+          wall, wall > 0 ? m_num_of_events / wall : 0);
+  // Everything that went through the event queue, including timer events
+  // that found their deadline moved or cleared
+  fprintf(stderr, "%llu events scheduled, %.0f per simulated second, %.0f of them for timers\n",
+          (unsigned long long) m_seq, m_now > START_TIME ? m_seq / (m_now - START_TIME) : 0,
+          timer_events_per_second());
+  uint64_t new_chunks = 0, duplicate_chunks = 0;
+  for (uint32_t i = 0; i < m_nodes.size(); i++) {
+    new_chunks += m_nodes[i].protocol.GetNumOfReceivedChunks();
+    duplicate_chunks += m_nodes[i].protocol.GetNumOfDuplicateChunks();
+  }
+  fprintf(stderr, "%llu new chunks, %llu duplicate chunks received\n",
+          (unsigned long long) new_chunks, (unsigned long long) duplicate_chunks);
+}
+
+bool ContactSim::write_results() {
+  std::set<uint32_t> files_start, files_end;
+  uint32_t full_files_start = 0, full_files_end = 0;
+  std::ofstream nodes((m_scenario.output_dir + "/nodes.csv").c_str());
+  if (!nodes)
+    return false;
+  nodes << "node,rank,full_files_start,full_files_end" << std::endl;
+  for (uint32_t i = 0; i < m_nodes.size(); i++) {
+    SimNode &node = m_nodes[i];
+    for (size_t j = 0; j < node.initial_files.size(); j++)
+      files_start.insert(node.initial_files[j].getFileId());
+    FileTable &files = node.protocol.files;
+    const std::vector<uint32_t> &full_slots = files.full_files();
+    for (size_t j = 0; j < full_slots.size(); j++)
+      files_end.insert(files[full_slots[j]].getFileId());
+    full_files_start += node.initial_files.size();
+    full_files_end += full_slots.size();
+    nodes << i << ",0," << node.initial_files.size() << "," << full_slots.size() << std::endl;
+  }
+  nodes.close();
+
+  printf("Stopped at time %g Unique files in the beginning: %u Total number of full files in the beginnig: %u, "
+         "full files in the end: %u unique files in the end %u\n",
+         m_now, (uint32_t) files_start.size(), full_files_start, full_files_end, (uint32_t) files_end.size());
+
+  std::ofstream summary((m_scenario.output_dir + "/summary.csv").c_str());
+  if (!summary)
+    return false;
+  summary << "run,nodes,files,max_files_per_node,duration,unique_files_start,full_files_start,full_files_end,unique_files_end,last_completion_time,timer_events_per_second,convergence_time,stop_time,events" << std::endl;
+  summary << m_scenario.run << "," << m_nodes.size() << "," << m_scenario.total_file_count << "," << m_scenario.max_file_count_per_node << ","
+    << m_scenario.duration << "," << files_start.size() << "," << full_files_start << "," << full_files_end << ","
+    << files_end.size() << "," << m_last_completion_time << "," << timer_events_per_second() << ","
+    << m_convergence_time << "," << m_now << "," << m_num_of_events << std::endl;
+  return true;
+}
+
+static void log_to_stderr(SmsLogLevel level, const std::string &message) {
+  fprintf(stderr, "%s %s\n", level == SMS_LEVEL_WARN ? "WARN" : "INFO", message.c_str());
+}
+
+static bool parse_bool(const std::string &value) {
+  return value == "1" || value == "true";
+}
+
+int main(int argc, char* argv[]) {
+  SimScenario scenario;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t equals = arg.find('=');
+    std::string name = arg.substr(0, equals);
+    std::string value = equals == std::string::npos ? "1" : arg.substr(equals + 1);
+    if (name == "--RngRun") scenario.run = atol(value.c_str());
+    else if (name == "--nodes") scenario.num_of_nodes = atol(value.c_str());
+    else if (name == "--files") scenario.total_file_count = atol(value.c_str());
+    else if (name == "--maxFilesPerNode") scenario.max_file_count_per_node = atol(value.c_str());
+    else if (name == "--zipfExponent") scenario.zipf_exponent = atof(value.c_str());
+    else if (name == "--duration") scenario.duration = atof(value.c_str());
+    else if (name == "--minX") scenario.min_x = atof(value.c_str());
+    else if (name == "--maxX") scenario.max_x = atof(value.c_str());
+    else if (name == "--minY") scenario.min_y = atof(value.c_str());
+    else if (name == "--maxY") scenario.max_y = atof(value.c_str());
+    else if (name == "--randomPlacement") scenario.random_placement = parse_bool(value);
+    else if (name == "--range") scenario.range = atof(value.c_str());
+    else if (name == "--loss") scenario.loss = atof(value.c_str());
+    else if (name == "--spatialIndex") scenario.spatial_index = parse_bool(value);
+    else if (name == "--chunkSize") scenario.chunk_size = atol(value.c_str());
+    else if (name == "--coding") scenario.coding = parse_bool(value);
+    else if (name == "--generationSize") scenario.generation_size = atol(value.c_str());
+    else if (name == "--loadBackoff") scenario.load_backoff = atof(value.c_str());
+    else if (name == "--maxAdvertisementDeferral") scenario.max_advertisement_deferral = atof(value.c_str());
+    else if (name == "--overheardRequestTimeout") scenario.overheard_request_timeout = atof(value.c_str());
+    else if (name == "--outputDir") scenario.output_dir = value;
+    else if (name == "--eventTrace") scenario.event_trace = value;
+    else if (name == "--metricsInterval") scenario.metrics_interval = atof(value.c_str());
+    else if (name == "--stopOnConvergence") scenario.stop_on_convergence = parse_bool(value);
+    else if (name == "--stallWindow") scenario.stall_window = atof(value.c_str());
+    else if (name == "--pcap") scenario.pcap = value;
+    else if (name == "--pcapNodes") scenario.pcap_nodes = value;
+    else if (name == "--pcapTypes") scenario.pcap_types = value;
+    else if (name == "--pcapStart") scenario.pcap_start = atof(value.c_str());
+    else if (name == "--pcapStop") scenario.pcap_stop = atof(value.c_str());
+    else if (name == "--pcapSnapLength") scenario.pcap_snap_length = atol(value.c_str());
+    else if (name == "--pcapRing") scenario.pcap_ring = atol(value.c_str());
+    else if (name == "--pcapTrigger") scenario.pcap_trigger = value;
+    else if (name == "--pcapCompress") scenario.pcap_compress = parse_bool(value);
+    else if (name == "--logLevel") scenario.log_level = atoi(value.c_str());
+    else {
+      fprintf(stderr, "Unknown option %s, see the comment at the top of tools/sms-contact-sim.cc\n", argv[i]);
+      return 1;
+    }
+  }
+  if (scenario.num_of_nodes == 0 || scenario.total_file_count == 0 || scenario.max_file_count_per_node == 0) {
+    fprintf(stderr, "--nodes, --files and --maxFilesPerNode must be positive\n");
+    return 1;
+  }
+  if (scenario.chunk_size == 0 || scenario.generation_size == 0) {
+    fprintf(stderr, "--chunkSize and --generationSize must be positive\n");
+    return 1;
+  }
+  if (mkdir(scenario.output_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Could not create output directory %s\n", scenario.output_dir.c_str());
+    return 1;
+  }
+  if (!scenario.event_trace.empty() && !EventTraceBuffer::open(scenario.event_trace.c_str())) {
+    fprintf(stderr, "Could not open event trace %s\n", scenario.event_trace.c_str());
+    return 1;
+  }
+  sms_log_set_sink(&log_to_stderr, (SmsLogLevel) scenario.log_level);
+
+  ContactSim sim(scenario);
+  sim.setup();
+  if (!sim.open_metrics()) {
+    fprintf(stderr, "Could not open %s/metrics.csv\n", scenario.output_dir.c_str());
+    return 1;
+  }
+  if (!sim.open_capture())
+    return 1;
+  sim.run();
+  bool written = sim.write_results();
+  EventTraceBuffer::close();
+  if (!written) {
+    fprintf(stderr, "Could not write the results to %s\n", scenario.output_dir.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,328 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Runs sms-main over a grid of parameters and seeds on all cores and
+ * aggregates the summary.csv of every run into <out>/sweep.csv, with the
+ * mean and the 95% confidence interval of each statistic per configuration.
+ *
+ * Usage: sms-sweep [--bin=./sms-main] [--out=sweep] [--jobs=<cores>]
+ *                  [--seeds=1-30] [--nodes=25,50] [--files=100]
+ *                  [--maxFilesPerNode=10] [--duration=100]
+ *                  [--arg=<extra sms-main argument>]...
+ *
+ * Every run writes to <out>/n<nodes>-f<files>-m<max>-d<duration>/run<seed>.
+ * Runs that already left a summary.csv are not run again, so an interrupted
+ * sweep can be resumed with the same command.
+ */
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdint.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_OF_STATS 7
+
+static const char* stat_names[NUM_OF_STATS] = {
+  "unique_files_start", "full_files_start", "full_files_end",
+  "unique_files_end", "last_completion_time", "convergence_time", "stop_time"
+};
+
+struct SweepRun {
+  std::string config;
+  std::string dir;
+  std::vector<std::string> args;
+};
+
+struct SweepStats {
+  SweepStats() : num_of_runs(0), num_of_failed(0) {}
+  uint32_t num_of_runs;
+  uint32_t num_of_failed;
+  std::vector<double> values[NUM_OF_STATS];
+};
+
+static std::vector<std::string> split(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+static bool make_dir(const std::string &path) {
+  // Creates all missing parents like mkdir -p
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i == path.size() || path[i] == '/') {
+      std::string prefix = path.substr(0, i);
+      if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+        return false;
+    }
+  }
+  return true;
+}
+
+static bool file_exists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+// Two-sided 95% quantile of Student's t distribution
+static double t_quantile(uint32_t degrees_of_freedom) {
+  static const double table[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  if (degrees_of_freedom == 0)
+    return 0;
+  if (degrees_of_freedom <= 30)
+    return table[degrees_of_freedom - 1];
+  if (degrees_of_freedom <= 60)
+    return 2.000;
+  if (degrees_of_freedom <= 120)
+    return 1.980;
+  return 1.960;
+}
+
+static void mean_and_ci(const std::vector<double> &values, double &mean, double &ci) {
+  mean = 0;
+  ci = 0;
+  if (values.empty())
+    return;
+  for (size_t i = 0; i < values.size(); i++)
+    mean += values[i];
+  mean /= values.size();
+  if (values.size() < 2)
+    return;
+  double sum_of_squares = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    sum_of_squares += (values[i] - mean) * (values[i] - mean);
+  double stddev = sqrt(sum_of_squares / (values.size() - 1));
+  ci = t_quantile(values.size() - 1) * stddev / sqrt((double) values.size());
+}
+
+static pid_t start_run(const std::string &bin, const SweepRun &run) {
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+  // Child: keep the console readable, everything goes to the run's log
+  int log = open((run.dir + "/log.txt").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (log >= 0) {
+    dup2(log, STDOUT_FILENO);
+    dup2(log, STDERR_FILENO);
+    close(log);
+  }
+  std::vector<char*> argv;
+  argv.push_back(const_cast<char*>(bin.c_str()));
+  for (size_t i = 0; i < run.args.size(); i++)
+    argv.push_back(const_cast<char*>(run.args[i].c_str()));
+  argv.push_back(0);
+  execv(bin.c_str(), &argv[0]);
+  perror(bin.c_str());
+  _exit(127);
+}
+
+// Reads the statistics from a run's summary.csv by column name. Columns
+// that summaries of older versions lack read as -1.
+static bool read_summary(const std::string &dir, double stats[NUM_OF_STATS]) {
+  FILE* f = fopen((dir + "/summary.csv").c_str(), "r");
+  if (f == 0)
+    return false;
+  char header[1024], line[1024];
+  bool ok = fgets(header, sizeof(header), f) != 0 && fgets(line, sizeof(line), f) != 0;
+  fclose(f);
+  if (!ok)
+    return false;
+  header[strcspn(header, "\r\n")] = 0;
+  line[strcspn(line, "\r\n")] = 0;
+  std::vector<std::string> names = split(header);
+  std::vector<std::string> fields = split(line);
+  if (fields.size() != names.size())
+    return false;
+  for (uint32_t i = 0; i < NUM_OF_STATS; i++) {
+    stats[i] = -1;
+    for (size_t j = 0; j < names.size(); j++) {
+      if (names[j] == stat_names[i])
+        stats[i] = atof(fields[j].c_str());
+    }
+  }
+  return stats[0] >= 0;
+}
+
+int main(int argc, char* argv[]) {
+  std::string bin = "./sms-main";
+  std::string out = "sweep";
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  std::string seeds = "1-30";
+  std::string nodes = "25";
+  std::string files = "100";
+  std::string max_files = "10";
+  std::string durations = "100";
+  std::vector<std::string> extra_args;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (name == "--bin") bin = value;
+    else if (name == "--out") out = value;
+    else if (name == "--jobs") jobs = atol(value.c_str());
+    else if (name == "--seeds") seeds = value;
+    else if (name == "--nodes") nodes = value;
+    else if (name == "--files") files = value;
+    else if (name == "--maxFilesPerNode") max_files = value;
+    else if (name == "--duration") durations = value;
+    else if (name == "--arg") extra_args.push_back(value);
+    else {
+      fprintf(stderr, "Unknown option %s, see the comment at the top of tools/sms-sweep.cc\n", argv[i]);
+      return 1;
+    }
+  }
+  if (jobs < 1)
+    jobs = 1;
+
+  uint32_t first_seed = 1;
+  uint32_t last_seed = 1;
+  if (sscanf(seeds.c_str(), "%u-%u", &first_seed, &last_seed) == 1)
+    last_seed = first_seed, first_seed = 1;
+  if (first_seed == 0 || last_seed < first_seed) {
+    fprintf(stderr, "--seeds takes a count or a range like 1-30, RngRun starts at 1\n");
+    return 1;
+  }
+
+  std::vector<std::string> node_list = split(nodes);
+  std::vector<std::string> file_list = split(files);
+  std::vector<std::string> max_file_list = split(max_files);
+  std::vector<std::string> duration_list = split(durations);
+
+  // The configurations in the order they appear in sweep.csv
+  std::vector<std::string> configs;
+  std::vector<SweepRun> runs;
+  for (size_t n = 0; n < node_list.size(); n++)
+    for (size_t f = 0; f < file_list.size(); f++)
+      for (size_t m = 0; m < max_file_list.size(); m++)
+        for (size_t d = 0; d < duration_list.size(); d++) {
+          std::string config = node_list[n] + "," + file_list[f] + "," + max_file_list[m] + "," + duration_list[d];
+          std::string config_dir = out + "/n" + node_list[n] + "-f" + file_list[f] + "-m" + max_file_list[m] + "-d" + duration_list[d];
+          configs.push_back(config);
+          for (uint32_t seed = first_seed; seed <= last_seed; seed++) {
+            std::stringstream dir;
+            dir << config_dir << "/run" << seed;
+            SweepRun run;
+            run.config = config;
+            run.dir = dir.str();
+            std::stringstream rng_run;
+            rng_run << "--RngRun=" << seed;
+            run.args.push_back(rng_run.str());
+            run.args.push_back("--nodes=" + node_list[n]);
+            run.args.push_back("--files=" + file_list[f]);
+            run.args.push_back("--maxFilesPerNode=" + max_file_list[m]);
+            run.args.push_back("--duration=" + duration_list[d]);
+            run.args.push_back("--outputDir=" + run.dir);
+            run.args.insert(run.args.end(), extra_args.begin(), extra_args.end());
+            runs.push_back(run);
+          }
+        }
+
+  // Fill up to 'jobs' worker processes, start the next run whenever one exits
+  uint32_t num_of_started = 0;
+  uint32_t num_of_skipped = 0;
+  uint32_t num_of_finished = 0;
+  uint32_t num_of_running = 0;
+  std::map<pid_t, size_t> running;
+  size_t next = 0;
+  while (next < runs.size() || num_of_running > 0) {
+    while (next < runs.size() && num_of_running < (uint32_t) jobs) {
+      SweepRun &run = runs[next++];
+      if (file_exists(run.dir + "/summary.csv")) {
+        num_of_skipped++;
+        continue;
+      }
+      if (!make_dir(run.dir)) {
+        perror(run.dir.c_str());
+        continue;
+      }
+      pid_t pid = start_run(bin, run);
+      if (pid < 0) {
+        perror("fork");
+        return 1;
+      }
+      running[pid] = next - 1;
+      num_of_started++;
+      num_of_running++;
+    }
+    if (num_of_running == 0)
+      break;
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      perror("waitpid");
+      return 1;
+    }
+    std::map<pid_t, size_t>::iterator it = running.find(pid);
+    if (it == running.end())
+      continue;
+    num_of_running--;
+    num_of_finished++;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      fprintf(stderr, "Run in %s failed, see its log.txt\n", runs[it->second].dir.c_str());
+    running.erase(it);
+    fprintf(stderr, "\r%u of %u runs done", num_of_finished, (uint32_t) runs.size() - num_of_skipped);
+  }
+  if (num_of_started > 0)
+    fprintf(stderr, "\n");
+  if (num_of_skipped > 0)
+    fprintf(stderr, "%u runs already had results and were skipped\n", num_of_skipped);
+
+  std::map<std::string, SweepStats> stats;
+  for (size_t i = 0; i < runs.size(); i++) {
+    SweepStats &s = stats[runs[i].config];
+    double values[NUM_OF_STATS];
+    if (!read_summary(runs[i].dir, values)) {
+      s.num_of_failed++;
+      continue;
+    }
+    s.num_of_runs++;
+    for (uint32_t j = 0; j < NUM_OF_STATS; j++) {
+      // Runs in which no file completed or that didn't converge have no
+      // such time
+      if (values[j] < 0)
+        continue;
+      s.values[j].push_back(values[j]);
+    }
+  }
+
+  std::string csv_path = out + "/sweep.csv";
+  FILE* csv = fopen(csv_path.c_str(), "w");
+  if (csv == 0) {
+    perror(csv_path.c_str());
+    return 1;
+  }
+  fprintf(csv, "nodes,files,max_files_per_node,duration,runs,failed_runs");
+  for (uint32_t j = 0; j < NUM_OF_STATS; j++)
+    fprintf(csv, ",%s_mean,%s_ci95", stat_names[j], stat_names[j]);
+  fprintf(csv, "\n");
+  for (size_t i = 0; i < configs.size(); i++) {
+    SweepStats &s = stats[configs[i]];
+    fprintf(csv, "%s,%u,%u", configs[i].c_str(), s.num_of_runs, s.num_of_failed);
+    for (uint32_t j = 0; j < NUM_OF_STATS; j++) {
+      double mean, ci;
+      mean_and_ci(s.values[j], mean, ci);
+      fprintf(csv, ",%g,%g", mean, ci);
+    }
+    fprintf(csv, "\n");
+  }
+  fclose(csv);
+  fprintf(stderr, "Wrote %s\n", csv_path.c_str());
+  return 0;
+}
@@ -0,0 +1,61 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Turns a binary event trace written with sms-main --eventTrace=<file> into
+ * CSV, sorted by time.
+ *
+ * Usage: sms-trace-decode <trace file> [<csv file>]
+ */
+#include "../sms-event-trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static bool earlier(const EventTraceRecord &a, const EventTraceRecord &b) {
+  return a.time_ns < b.time_ns;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <trace file> [<csv file>]\n", argv[0]);
+    return 1;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (in == 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  EventTraceFileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1
+      || strncmp(header.magic, EVENT_TRACE_MAGIC, sizeof(header.magic)) != 0
+      || header.record_size != sizeof(EventTraceRecord)) {
+    fprintf(stderr, "%s is not an event trace written by this version\n", argv[1]);
+    return 1;
+  }
+  std::vector<EventTraceRecord> records;
+  EventTraceRecord chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, sizeof(EventTraceRecord), 4096, in)) > 0) {
+    records.insert(records.end(), chunk, chunk + n);
+  }
+  fclose(in);
+  // Every node flushes its own buffer, so the file is only sorted per node
+  std::stable_sort(records.begin(), records.end(), earlier);
+
+  FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+  if (out == 0) {
+    perror(argv[2]);
+    return 1;
+  }
+  fprintf(out, "time_s,node,event,peer,file_id,chunk_id,count\n");
+  for (size_t i = 0; i < records.size(); i++) {
+    const EventTraceRecord &r = records[i];
+    fprintf(out, "%.9f,%u,%s,", r.time_ns / 1e9, r.node, event_trace_type_name(r.type));
+    if (r.peer != 0)
+      fprintf(out, "%u.%u.%u.%u", r.peer >> 24, (r.peer >> 16) & 0xFF, (r.peer >> 8) & 0xFF, r.peer & 0xFF);
+    fprintf(out, ",%u,%u,%u\n", r.file_id, r.chunk_id, r.count);
+  }
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}